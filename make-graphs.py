@@ -12,6 +12,13 @@ GRAPH_PATH='./doc/tests/graphs/8core';
 TITLE="8 core configuration"
 
 TYPES = ['onethread', 'mutex', 'tm-tiny'];
+
+# backend column of tester output -> type
+OUTPUTS = {
+    'tester': { 'NONE': 'onethread', 'MUTEX': 'mutex', 'TM': 'tm-gnu' },
+    'tester-tm-tiny': { 'TM': 'tm-tiny' },
+};
+
 LINE_STYLES = {
     'onethread' : '-',
     'mutex': '-',
@@ -32,8 +39,11 @@ class GraphData:
 def read_data():
     data = {};
     
-    for typename in TYPES:
-        f = open(DATA_PATH + '/tester-%s.txt' % typename, 'r');
+    for (tester, backends) in OUTPUTS.iteritems():
+        path = DATA_PATH + '/%s.txt' % tester;
+        if not os.path.exists(path):
+            continue;
+        f = open(path, 'r');
         for line in f:
             if line[0] != '>':
                 continue;
@@ -47,6 +57,12 @@ def read_data():
             check=line[3];
             if check != "OK":
                 continue;
+
+            if not prefix in backends:
+                continue;
+            typename = backends[prefix];
+            if not typename in TYPES:
+                continue;
             
             inputsize=float(line[4]);
             numthreads=int(line[5]);
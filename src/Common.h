@@ -32,20 +32,677 @@
 #ifndef LOCKS_H
 #define LOCKS_H
 
-#if defined(LOCKTYPE_NONE)
-#define BEGIN_CRITICAL_SECTION() {
-#define END_CRITICAL_SECTION() }
-#define LOCKTYPE "NONE"
-#elif defined(LOCKTYPE_MUTEX)
-#define BEGIN_CRITICAL_SECTION() std::lock_guard<std::mutex> locker(lock); {
-#define END_CRITICAL_SECTION() }
-#define LOCKTYPE "MUTEX"
-#elif defined(LOCKTYPE_TM)
-#define BEGIN_CRITICAL_SECTION() __transaction_atomic {
-#define END_CRITICAL_SECTION() }
-#define LOCKTYPE "TM"
+#include <stdint.h>
+#include <stdlib.h>
+#include <mutex>
+#include <map>
+#include <string>
+#include <iostream>
+
+#include <Utils/SpinLocks.h>
+#include <Utils/FlatCombiner.h>
+#include <Utils/DelegationServer.h>
+#include <Utils/ThreadPool.h>
+#include <Utils/MemoryAccess.h>
+#include <Utils/STM.h>
+#include <Utils/AdaptiveController.h>
+
+#ifdef CRITICAL_SECTION_STATS
+#include <x86intrin.h>
+#endif
+
+/*
+ * TM runtime introspection, weak because not every runtime provides it:
+ * _ITM_inTransaction() is a part of the ITM ABI (libitm),
+ * stm_get_stats() is exported by TinySTM built with statistics
+ */
+extern "C" {
+int _ITM_inTransaction(void) __attribute__((weak));
+int stm_get_stats(const char *name, void *value) __attribute__((weak));
+}
+
+/**
+ * Critical section policies.
+ *
+ * Every policy is a lock object with execute(function) method which runs
+ * the function inside of the critical section. Tests are templates
+ * parametrized by the policy, so all of them are compiled into one binary
+ * and a backend is selected at runtime.
+ */
+namespace Locks {
+
+/**
+ * Per-thread statistics of critical sections, collected only if compiled
+ * with -DCRITICAL_SECTION_STATS (make STATS=1).
+ *
+ * Wait is the time from entering execute() to the start of the successful
+ * attempt (lock acquisition or aborted transactions), hold is the duration
+ * of the successful attempt. All times are in TSC cycles.
+ */
+struct SectionStats {
+    SectionStats() {
+        reset();
+    }
+
+    void reset() {
+        entries = 0;
+        attempts = 0;
+        waitCycles = 0;
+        holdCycles = 0;
+        abortedCycles = 0;
+        enterTime = 0;
+        attemptTime = 0;
+    }
+
+    void merge(const SectionStats& other) {
+        entries += other.entries;
+        attempts += other.attempts;
+        waitCycles += other.waitCycles;
+        holdCycles += other.holdCycles;
+        abortedCycles += other.abortedCycles;
+    }
+
+    static SectionStats& current() {
+        static thread_local SectionStats stats;
+        return stats;
+    }
+
+#ifdef CRITICAL_SECTION_STATS
+    void enter() {
+        entries++;
+        enterTime = __rdtsc();
+        attemptTime = 0;
+    }
+
+    /**
+     * Start of an attempt, called inside of transactions too
+     */
+    __attribute__((transaction_pure))
+    static void attempt() {
+        SectionStats& stats = current();
+        const uint64_t now = __rdtsc();
+        if (stats.attemptTime != 0) {
+            // the previous attempt was aborted
+            stats.abortedCycles += now - stats.attemptTime;
+        }
+
+        stats.attempts++;
+        stats.attemptTime = now;
+    }
+
+    void leave() {
+        const uint64_t now = __rdtsc();
+        waitCycles += attemptTime - enterTime;
+        holdCycles += now - attemptTime;
+    }
+#endif
+
+    uint64_t entries;
+    uint64_t attempts;
+    uint64_t waitCycles;
+    uint64_t holdCycles;
+    uint64_t abortedCycles;
+
+    // current section
+    uint64_t enterTime;
+    uint64_t attemptTime;
+};
+
+/**
+ * Per-thread transaction statistics of the TM backend.
+ *
+ * Attempts are counted inside of the transaction, so retries are counted
+ * too, commits are counted after it. Abort reasons are available only
+ * from TinySTM.
+ */
+struct TMStats {
+    enum AbortReason {
+        ABORT_LOCKED_READ,
+        ABORT_LOCKED_WRITE,
+        ABORT_VALIDATE_READ,
+        ABORT_VALIDATE_WRITE,
+        ABORT_VALIDATE_COMMIT,
+        ABORT_KILLED,
+        ABORT_REASONS_COUNT
+    };
+
+    static const char *reasonName(size_t reason) {
+        static const char *NAMES[ABORT_REASONS_COUNT] = {
+            "locked_read", "locked_write", "validate_read", "validate_write",
+            "validate_commit", "killed"
+        };
+
+        return NAMES[reason];
+    }
+
+    TMStats() {
+        reset();
+        for(size_t reason = 0; reason < ABORT_REASONS_COUNT; reason++) {
+            m_lastReasons[reason] = 0;
+        }
+    }
+
+    void reset() {
+        attempts = 0;
+        commits = 0;
+        irrevocable = 0;
+        hasReasons = false;
+        for(size_t reason = 0; reason < ABORT_REASONS_COUNT; reason++) {
+            aborts[reason] = 0;
+        }
+    }
+
+    /**
+     * Take abort reasons from the runtime: its counters are cumulative per
+     * thread and may be read only by a thread which executed transactions.
+     * Backends which count reasons themselves (stm) set hasReasons.
+     */
+    void finish() {
+        uint64_t reasons[ABORT_REASONS_COUNT];
+        if (attempts == 0 || hasReasons || !runtimeReasons(reasons)) {
+            return;
+        }
+
+        hasReasons = true;
+        for(size_t reason = 0; reason < ABORT_REASONS_COUNT; reason++) {
+            aborts[reason] = reasons[reason] - m_lastReasons[reason];
+            m_lastReasons[reason] = reasons[reason];
+        }
+    }
+
+    void merge(const TMStats& other) {
+        attempts += other.attempts;
+        commits += other.commits;
+        irrevocable += other.irrevocable;
+        hasReasons = hasReasons || other.hasReasons;
+        for(size_t reason = 0; reason < ABORT_REASONS_COUNT; reason++) {
+            aborts[reason] += other.aborts[reason];
+        }
+    }
+
+    static TMStats& current() {
+        static thread_local TMStats stats;
+        return stats;
+    }
+
+    /**
+     * Start of a transaction attempt
+     */
+    __attribute__((transaction_pure))
+    static void attempt() {
+        TMStats& stats = current();
+        stats.attempts++;
+
+        // _ITM_howExecuting: inIrrevocableTransaction
+        if (_ITM_inTransaction != NULL && _ITM_inTransaction() == 2) {
+            stats.irrevocable++;
+        }
+    }
+
+    uint64_t attempts;
+    uint64_t commits;
+    // attempts executed in serial irrevocable mode
+    uint64_t irrevocable;
+    bool hasReasons;
+    uint64_t aborts[ABORT_REASONS_COUNT];
+
+protected:
+    static bool runtimeReasons(uint64_t *reasons) {
+        static const char *STM_NAMES[ABORT_REASONS_COUNT] = {
+            "nb_aborts_locked_read", "nb_aborts_locked_write",
+            "nb_aborts_validate_read", "nb_aborts_validate_write",
+            "nb_aborts_validate_commit", "nb_aborts_killed"
+        };
+
+        if (stm_get_stats == NULL) {
+            return false;
+        }
+
+        for(size_t reason = 0; reason < ABORT_REASONS_COUNT; reason++) {
+            unsigned long value = 0;
+            if (stm_get_stats(STM_NAMES[reason], &value) == 0) {
+                return false;
+            }
+
+            reasons[reason] = value;
+        }
+
+        return true;
+    }
+
+    // runtime counters at the previous finish()
+    uint64_t m_lastReasons[ABORT_REASONS_COUNT];
+};
+
+#ifdef CRITICAL_SECTION_STATS
+#define SECTION_STATS(statement) statement
 #else
-#error Please define LOCKTYPE_NONE or LOCKTYPE_TM or LOCKTYPE_MUTEX
+#define SECTION_STATS(statement)
 #endif
 
+/**
+ * Base of policies, configure() takes options of the config line
+ */
+struct Policy {
+    // containers of tests access shared fields directly
+    typedef Utils::DirectAccess Access;
+
+    /**
+     * Returns false if some option of the policy has an invalid value
+     */
+    bool configure(const std::map<std::string, std::string>& options) {
+        return true;
+    }
+
+    /**
+     * Called before and after every run of threadsCount workers
+     */
+    void start(size_t threadsCount) {
+        // nothing
+    }
+
+    void stop() {
+        // nothing
+    }
+};
+
+/**
+ * No synchronization at all (single-threaded runs only)
+ */
+struct None: public Policy {
+    template<class Function>
+    void execute(Function function) {
+        SECTION_STATS(SectionStats::current().enter());
+        SECTION_STATS(SectionStats::attempt());
+        function();
+        SECTION_STATS(SectionStats::current().leave());
+    }
+};
+
+/**
+ * std::mutex from C++1x standard
+ */
+struct Mutex: public Policy {
+    template<class Function>
+    void execute(Function function) {
+        SECTION_STATS(SectionStats::current().enter());
+        std::lock_guard<std::mutex> locker(m_mutex);
+        SECTION_STATS(SectionStats::attempt());
+        function();
+        SECTION_STATS(SectionStats::current().leave());
+    }
+
+    std::mutex m_mutex;
+};
+
+/**
+ * Lock with lock() and unlock() methods from Utils/SpinLocks.h
+ */
+template<class LockType>
+struct Lock: public Policy {
+    template<class Function>
+    void execute(Function function) {
+        SECTION_STATS(SectionStats::current().enter());
+        m_lock.lock();
+        SECTION_STATS(SectionStats::attempt());
+        function();
+        SECTION_STATS(SectionStats::current().leave());
+        m_lock.unlock();
+    }
+
+    LockType m_lock;
+};
+
+typedef Lock<Utils::TTASLock> TTAS;
+typedef Lock<Utils::TicketLock> Ticket;
+typedef Lock<Utils::MCSLock> MCS;
+typedef Lock<Utils::CLHLock> CLH;
+typedef Lock<Utils::FutexMutex> Futex;
+
+/**
+ * Flat combining: the function is published in the slot of the calling
+ * thread and executed by whichever thread combines (see Utils/FlatCombiner.h).
+ * Hold time is the time from publishing to completion.
+ */
+struct FlatCombining: public Policy {
+    template<class Function>
+    void execute(Function function) {
+        SECTION_STATS(SectionStats::current().enter());
+        SECTION_STATS(SectionStats::attempt());
+        m_combiner.execute(Utils::ThreadPool::threadId(), function);
+        SECTION_STATS(SectionStats::current().leave());
+    }
+
+    Utils::FlatCombiner m_combiner;
+};
+
+/**
+ * Delegation: functions are executed by a dedicated server thread
+ * (see Utils/DelegationServer.h), pinned to a CPU with server_cpu=N.
+ * Hold time is the time from posting to completion.
+ */
+struct Delegation: public Policy {
+    Delegation() {
+        m_isReported = false;
+    }
+
+    bool configure(const std::map<std::string, std::string>& options) {
+        std::map<std::string, std::string>::const_iterator it = options.find("server_cpu");
+        if (it == options.end() || it->second == "none") {
+            m_server.pin(-1);
+            return true;
+        }
+
+        char *end;
+        const long cpu = strtol(it->second.c_str(), &end, 10);
+        if (it->second.empty() || *end != '\0' || cpu < 0 || !m_server.pin(cpu)) {
+            std::cerr << "Invalid server CPU: " << it->second << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    void start(size_t threadsCount) {
+        if (threadsCount > Utils::DelegationServer::MAX_CLIENTS && !m_isReported) {
+            std::cerr << "Delegation: " << threadsCount << " threads share "
+                      << Utils::DelegationServer::MAX_CLIENTS << " mailboxes" << std::endl;
+            m_isReported = true;
+        }
+
+        m_server.start();
+    }
+
+    void stop() {
+        m_server.stop();
+    }
+
+    template<class Function>
+    void execute(Function function) {
+        SECTION_STATS(SectionStats::current().enter());
+        SECTION_STATS(SectionStats::attempt());
+        m_server.execute(Utils::ThreadPool::threadId(), function);
+        SECTION_STATS(SectionStats::current().leave());
+    }
+
+    Utils::DelegationServer m_server;
+    bool m_isReported;
+};
+
+/**
+ * GCC transactional memory (requires -fgnu-tm)
+ */
+struct TM: public Policy {
+    template<class Function>
+    void execute(Function function) {
+        SECTION_STATS(SectionStats::current().enter());
+        __transaction_atomic {
+            TMStats::attempt();
+            SECTION_STATS(SectionStats::attempt());
+            function();
+        }
+        TMStats::current().commits++;
+        SECTION_STATS(SectionStats::current().leave());
+    }
+};
+
+/**
+ * In-tree TL2-style STM (see Utils/STM.h), doesn't need -fgnu-tm.
+ * Only accesses through Access are transactional, so it works only with
+ * tests whose containers are parameterized by it (INSTRUMENTED tests).
+ *
+ * Options (global for the runtime):
+ *   stm_orecs=1048576 - ownership records, a power of two
+ *   stm_stripe=8 - bytes guarded by one orec, a power of two >= 8
+ *   stm_clock=gv4 - gv1 or gv4 global clock
+ *   stm_cm=backoff - contention manager: suicide, wait or backoff
+ */
+struct STM: public Policy {
+    typedef Utils::STM::Access Access;
+
+    bool configure(const std::map<std::string, std::string>& options) {
+        Utils::STM::Config config;
+        if (!sizeOption(options, "stm_orecs", 1, &config.orecsCount) ||
+                !sizeOption(options, "stm_stripe", sizeof(Utils::STM::Word),
+                            &config.stripeSize)) {
+            return false;
+        }
+
+        std::map<std::string, std::string>::const_iterator it = options.find("stm_clock");
+        if (it != options.end()) {
+            if (it->second == "gv1") {
+                config.clock = Utils::STM::CLOCK_GV1;
+            } else if (it->second == "gv4") {
+                config.clock = Utils::STM::CLOCK_GV4;
+            } else {
+                std::cerr << "Invalid STM clock: " << it->second << std::endl;
+                return false;
+            }
+        }
+
+        it = options.find("stm_cm");
+        if (it != options.end()) {
+            if (it->second == "suicide") {
+                config.contention = Utils::STM::CM_SUICIDE;
+            } else if (it->second == "wait") {
+                config.contention = Utils::STM::CM_WAIT;
+            } else if (it->second == "backoff") {
+                config.contention = Utils::STM::CM_BACKOFF;
+            } else {
+                std::cerr << "Invalid STM contention manager: " << it->second << std::endl;
+                return false;
+            }
+        }
+
+        Utils::STM::Runtime::instance().configure(config);
+        return true;
+    }
+
+    template<class Function>
+    void execute(Function function) {
+        SECTION_STATS(SectionStats::current().enter());
+        TMStats& stats = TMStats::current();
+        while (true) {
+            Utils::STM::txBegin();
+            stats.attempts++;
+            SECTION_STATS(SectionStats::attempt());
+            try {
+                function();
+                Utils::STM::txCommit();
+                break;
+            } catch (const Utils::STM::Abort& abort) {
+                stats.hasReasons = true;
+                stats.aborts[reasonOf(abort.reason)]++;
+            }
+        }
+
+        stats.commits++;
+        SECTION_STATS(SectionStats::current().leave());
+    }
+
+protected:
+    static TMStats::AbortReason reasonOf(Utils::STM::AbortReason reason) {
+        switch (reason) {
+        case Utils::STM::ABORT_LOCKED_READ:
+            return TMStats::ABORT_LOCKED_READ;
+        case Utils::STM::ABORT_LOCKED_WRITE:
+            return TMStats::ABORT_LOCKED_WRITE;
+        case Utils::STM::ABORT_VALIDATE_READ:
+            return TMStats::ABORT_VALIDATE_READ;
+        default:
+            return TMStats::ABORT_VALIDATE_COMMIT;
+        }
+    }
+
+    /**
+     * Power of two option not less than minimum
+     */
+    static bool sizeOption(const std::map<std::string, std::string>& options,
+                           const char *name, size_t minimum, size_t *value) {
+        std::map<std::string, std::string>::const_iterator it = options.find(name);
+        if (it == options.end()) {
+            return true;
+        }
+
+        char *end;
+        const unsigned long parsed = strtoul(it->second.c_str(), &end, 10);
+        if (it->second.empty() || *end != '\0' || parsed < minimum ||
+                (parsed & (parsed - 1)) != 0) {
+            std::cerr << "Invalid " << name << ": " << it->second << std::endl;
+            return false;
+        }
+
+        *value = parsed;
+        return true;
+    }
+};
+
+/**
+ * GCC transactional memory or LockType, chosen per critical section site
+ * by Utils::AdaptiveController. Lock executions exclude transactions:
+ * the lock holder waits until transactions in flight finish and new ones
+ * wait until the lock is released, so sites in different modes may share
+ * data. Decisions are printed to stderr when the test is destroyed.
+ */
+template<class LockType>
+struct Adaptive: public Policy {
+    typedef Utils::AdaptiveController Controller;
+
+    // threads with larger ids always take the lock
+    static const size_t MAX_THREADS = 256;
+
+    Adaptive() {
+        m_lockHeld.store(false);
+        m_slotsUsed.store(0);
+        for (size_t threadId = 0; threadId < MAX_THREADS; threadId++) {
+            m_slots[threadId].active.store(false);
+        }
+    }
+
+    ~Adaptive() {
+        m_controller.report(std::cerr);
+    }
+
+    // disable evil constructors
+    Adaptive(const Adaptive& policy);
+    Adaptive& operator=(const Adaptive& policy);
+
+    template<class Function>
+    void execute(Function function, const char *file = "unknown", int line = 0) {
+        // every BEGIN_CRITICAL_SECTION() has its own lambda type
+        static const size_t siteId = Controller::registerSite();
+
+        SECTION_STATS(SectionStats::current().enter());
+        const uint64_t t0 = Utils::Timer::cycles();
+        const size_t threadId = Utils::ThreadPool::threadId();
+        Controller::Mode mode = m_controller.mode(siteId);
+        uint64_t attempts = 1;
+        uint64_t failures = 0;
+        if (mode == Controller::MODE_TM && threadId < MAX_THREADS) {
+            enterTransaction(threadId);
+            TMStats& stats = TMStats::current();
+            const uint64_t attemptsBefore = stats.attempts;
+            __transaction_atomic {
+                TMStats::attempt();
+                SECTION_STATS(SectionStats::attempt());
+                function();
+            }
+            stats.commits++;
+            m_slots[threadId].active.store(false, std::memory_order_release);
+            attempts = stats.attempts - attemptsBefore;
+            failures = attempts - 1;
+        } else {
+            mode = Controller::MODE_LOCK;
+            m_lock.lock();
+            waitTransactions();
+            SECTION_STATS(SectionStats::attempt());
+            function();
+            m_lockHeld.store(false, std::memory_order_release);
+            m_lock.unlock();
+        }
+
+        m_controller.record(siteId, file, line, mode, attempts, failures,
+                            Utils::Timer::cycles() - t0);
+        SECTION_STATS(SectionStats::current().leave());
+    }
+
+protected:
+    struct Slot {
+        // the thread is inside of a transaction
+        std::atomic<bool> active;
+        char padding[Utils::CACHE_LINE_SIZE - sizeof(std::atomic<bool>)];
+    };
+
+    /*
+     * Dekker-style handshake with waitTransactions(): each side stores its
+     * flag and then loads the other one. Mutual exclusion holds only if
+     * both stores and both loads are seq_cst, so don't weaken them.
+     */
+    void enterTransaction(size_t threadId) {
+        size_t used = m_slotsUsed.load();
+        while (used <= threadId && !m_slotsUsed.compare_exchange_weak(used, threadId + 1)) {
+            // retry
+        }
+
+        Slot& slot = m_slots[threadId];
+        Utils::SpinWait spin;
+        while (true) {
+            while (m_lockHeld.load(std::memory_order_acquire)) {
+                spin.wait();
+            }
+
+            slot.active.store(true, std::memory_order_seq_cst);
+            if (!m_lockHeld.load(std::memory_order_seq_cst)) {
+                return;
+            }
+
+            slot.active.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void waitTransactions() {
+        m_lockHeld.store(true, std::memory_order_seq_cst);
+        const size_t used = m_slotsUsed.load(std::memory_order_seq_cst);
+        Utils::SpinWait spin;
+        for (size_t threadId = 0; threadId < used; threadId++) {
+            while (m_slots[threadId].active.load(std::memory_order_seq_cst)) {
+                spin.wait();
+            }
+        }
+    }
+
+    LockType m_lock;
+    char m_padding0[Utils::CACHE_LINE_SIZE];
+    std::atomic<bool> m_lockHeld;
+    std::atomic<size_t> m_slotsUsed;
+    char m_padding1[Utils::CACHE_LINE_SIZE];
+    Slot m_slots[MAX_THREADS];
+    Controller m_controller;
+};
+
+typedef Adaptive<Utils::FutexMutex> AdaptiveFutex;
+typedef Adaptive<Utils::MCSLock> AdaptiveMCS;
+
+/**
+ * Execute function as the critical section at file:line of a test,
+ * only the adaptive policy tells sites apart
+ */
+template<class LockPolicy, class Function>
+void executeAt(LockPolicy& policy, Function function, const char *, int) {
+    policy.execute(function);
+}
+
+template<class LockType, class Function>
+void executeAt(Adaptive<LockType>& policy, Function function, const char *file, int line) {
+    policy.execute(function, file, line);
+}
+
+} // namespace Locks
+
+/*
+ * Used inside of SynchronizedTest methods
+ */
+#define BEGIN_CRITICAL_SECTION() this->criticalSection([&]() {
+#define END_CRITICAL_SECTION() })
+
 #endif // LOCKS_H
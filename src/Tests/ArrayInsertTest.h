@@ -36,7 +36,8 @@
 
 #include <Utils/Vector.h>
 
-class ArrayInsertTest: public NumbersTest {
+template<class LockPolicy>
+class ArrayInsertTest: public SynchronizedTest<LockPolicy> {
 public:
     typedef Utils::Vector<int> MyVector;
 
@@ -48,12 +49,34 @@ public:
         m_sharedVector.clear();
     }
 
+    virtual bool containerStats(Utils::ContainerStats *stats) const {
+        *stats = m_sharedVector.stats();
+        return true;
+    }
+
     virtual bool check() {
-        std::vector<int> inputSorted(m_input);
+        if (this->m_sortCheck) {
+            return sortCheck();
+        }
+
+        return this->fingerprint(m_sharedVector) == this->m_inputFingerprint;
+    }
+
+protected:
+    virtual bool containerFingerprint(Utils::Fingerprint *result) {
+        *result = this->fingerprint(m_sharedVector);
+        return true;
+    }
+
+    /**
+     * Full check, enabled by check=sort
+     */
+    bool sortCheck() {
+        std::vector<int> inputSorted(this->m_input.begin(), this->m_input.end());
         std::sort(inputSorted.begin(), inputSorted.end());
         std::sort(m_sharedVector.begin(), m_sharedVector.end());
 
-        for (size_t i = 0; i < m_inputSize; i++) {
+        for (size_t i = 0; i < this->m_inputSize; i++) {
             if (inputSorted[i] != m_sharedVector[i]) {
                 return false;
             }
@@ -62,11 +85,10 @@ public:
         return true;
     }
 
-protected:
     virtual void worker(size_t start, size_t end) {
         for(size_t i = start; i < end; i++) {
             BEGIN_CRITICAL_SECTION();
-                m_sharedVector.pushBack(m_input[i]);
+                m_sharedVector.pushBack(this->m_input[i]);
             END_CRITICAL_SECTION();
         }
     }
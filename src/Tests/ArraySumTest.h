@@ -34,7 +34,8 @@
 
 #include "Test.h"
 
-class ArraySumTest: public NumbersTest {
+template<class LockPolicy>
+class ArraySumTest: public SynchronizedTest<LockPolicy> {
 public:
     virtual void setup() {
         m_sharedSum = 0;
@@ -42,8 +43,8 @@ public:
 
     virtual bool check() {
         size_t refSum = 0;
-        for(size_t i = 0; i < m_inputSize; i++) {
-            refSum += m_input[i];
+        for(size_t i = 0; i < this->m_inputSize; i++) {
+            refSum += this->m_input[i];
         }
 
         return (refSum == m_sharedSum);
@@ -53,7 +54,7 @@ protected:
     virtual void worker(size_t start, size_t end) {
         size_t localSum = 0;
         for(size_t i = start; i < end; i++) {
-            localSum += m_input[i];
+            localSum += this->m_input[i];
         }
 
         BEGIN_CRITICAL_SECTION();
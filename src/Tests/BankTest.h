@@ -469,9 +469,10 @@ public:
     virtual void generate(size_t inputSize, size_t threadsCount) {
         AbstractTest::generate(inputSize, threadsCount);
 
+        Utils::Random random(m_seed);
         m_input.resize(m_inputSize);
         for(size_t i = 0; i < m_inputSize; i++) {
-            m_input[i] = m_rnd() % 1000;
+            m_input[i] = random.uniform(1000);
         }
 
         const size_t keysPerThread = m_inputSize / m_threadsCount;
@@ -35,19 +35,22 @@
 #include "Test.h"
 #include <Utils/HashMap.h>
 
-class HashInsertTest: public NumbersTest {
+template<class LockPolicy>
+class HashInsertTest: public SynchronizedTest<LockPolicy> {
 public:
-    typedef Utils::HashMap<int, int> MyMap;
+    static const bool INSTRUMENTED = true;
+
+    typedef Utils::HashMap<int, int, typename LockPolicy::Access> MyMap;
 
     virtual void setup() {
         m_sharedMap.clear();
 
         // HACK: performance
         const size_t maxBuckets = 1048576;
-        if (m_inputSize > maxBuckets) {
+        if (this->m_inputSize > maxBuckets) {
             m_sharedMap.reserve(maxBuckets);
         } else {
-            m_sharedMap.reserve(m_inputSize);
+            m_sharedMap.reserve(this->m_inputSize);
         }
     }
 
@@ -55,12 +58,40 @@ public:
         m_sharedMap.clear();
     }
 
+#ifdef CONTAINER_HEATMAP
+    virtual Utils::Heatmap *heatmap() {
+        return &m_sharedMap.heatmap();
+    }
+#endif
+
+    virtual bool containerStats(Utils::ContainerStats *stats) const {
+        *stats = m_sharedMap.stats();
+        return true;
+    }
+
     virtual bool check() {
-        std::vector<int> inputSorted(m_input);
+        if (this->m_sortCheck) {
+            return sortCheck();
+        }
+
+        return this->fingerprint(m_sharedMap) == this->m_inputFingerprint;
+    }
+
+protected:
+    virtual bool containerFingerprint(Utils::Fingerprint *result) {
+        *result = this->fingerprint(m_sharedMap);
+        return true;
+    }
+
+    /**
+     * Full check, enabled by check=sort
+     */
+    bool sortCheck() {
+        std::vector<int> inputSorted(this->m_input.begin(), this->m_input.end());
         std::vector<int> resultSorted;
         resultSorted.reserve(inputSorted.size());
 
-        for(MyMap::Iterator it = m_sharedMap.begin(); it != m_sharedMap.end(); it++) {
+        for(typename MyMap::Iterator it = m_sharedMap.begin(); it != m_sharedMap.end(); it++) {
             resultSorted.push_back(it.key());
         }
 
@@ -83,12 +114,10 @@ public:
         return true;
     }
 
-protected:
-
     virtual void worker(size_t start, size_t end) {
         for(size_t i = start; i < end; i++) {
             BEGIN_CRITICAL_SECTION();
-                m_sharedMap.insertMulti(m_input[i], 0);
+                m_sharedMap.insertMulti(this->m_input[i], 0);
             END_CRITICAL_SECTION();
         }
     }
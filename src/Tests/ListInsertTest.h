@@ -35,7 +35,8 @@
 #include "Test.h"
 #include <Utils/LinkedList.h>
 
-class ListInsertTest: public NumbersTest {
+template<class LockPolicy>
+class ListInsertTest: public SynchronizedTest<LockPolicy> {
 public:
     typedef Utils::LinkedList<int> MyList;
 
@@ -47,12 +48,34 @@ public:
         m_sharedList.clear();
     }
 
+    virtual bool containerStats(Utils::ContainerStats *stats) const {
+        *stats = m_sharedList.stats();
+        return true;
+    }
+
     virtual bool check() {
-        std::vector<int> inputSorted(m_input);
+        if (this->m_sortCheck) {
+            return sortCheck();
+        }
+
+        return this->fingerprint(m_sharedList) == this->m_inputFingerprint;
+    }
+
+protected:
+    virtual bool containerFingerprint(Utils::Fingerprint *result) {
+        *result = this->fingerprint(m_sharedList);
+        return true;
+    }
+
+    /**
+     * Full check, enabled by check=sort
+     */
+    bool sortCheck() {
+        std::vector<int> inputSorted(this->m_input.begin(), this->m_input.end());
         std::vector<int> resultSorted;
         resultSorted.reserve(inputSorted.size());
 
-        for(MyList::Iterator it = m_sharedList.begin(); it != m_sharedList.end(); it++) {
+        for(typename MyList::Iterator it = m_sharedList.begin(); it != m_sharedList.end(); it++) {
             resultSorted.push_back(it.value());
         }
 
@@ -75,16 +98,18 @@ public:
         return true;
     }
 
-protected:
-
     virtual void worker(size_t start, size_t end) {
+        // bit 63 keeps the stream apart from the input generation streams
+        Utils::Random random(this->m_seed,
+                             ((uint64_t) 1 << 63) | Utils::ThreadPool::threadId());
+
         for(size_t i = start; i < end; i++) {
-            bool back = (rand() % 2);
+            bool back = (random.next() & 1);
             BEGIN_CRITICAL_SECTION();
                 if (back) {
-                    m_sharedList.pushBack(m_input[i]);
+                    m_sharedList.pushBack(this->m_input[i]);
                 } else {
-                    m_sharedList.pushFront(m_input[i]);
+                    m_sharedList.pushFront(this->m_input[i]);
                 }
             END_CRITICAL_SECTION();
         }
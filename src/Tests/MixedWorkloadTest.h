@@ -0,0 +1,455 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MIXEDWORKLOADTEST_H
+#define MIXEDWORKLOADTEST_H
+
+#include "Test.h"
+
+#include <iomanip>
+#include <sstream>
+#include <Utils/TreeSet.h>
+#include <Utils/TreeMap.h>
+#include <Utils/HashMap.h>
+
+namespace MixedWorkload {
+
+enum Operation {
+    OP_FIND,
+    OP_CONTAINS,
+    OP_INSERT,
+    OP_INSERT_MULTI,
+    OP_REMOVE_ALL,
+    OP_MAX
+};
+
+static const char *OPERATION_NAMES[OP_MAX] = {
+    "find", "contains", "insert", "insertMulti", "removeAll"
+};
+
+/*
+ * Insert operations differ between sets and maps
+ */
+template<class KeyType, class Access>
+void insert(Utils::TreeSet<KeyType, Access>& set, const KeyType& key) {
+    set.insert(key);
+}
+
+template<class KeyType, class Access>
+void insertMulti(Utils::TreeSet<KeyType, Access>& set, const KeyType& key) {
+    set.insertMulti(key);
+}
+
+template<class KeyType, class ValueType, class Access>
+void insert(Utils::TreeMap<KeyType, ValueType, Access>& map, const KeyType& key) {
+    map.insert(key, ValueType());
+}
+
+template<class KeyType, class ValueType, class Access>
+void insertMulti(Utils::TreeMap<KeyType, ValueType, Access>& map, const KeyType& key) {
+    map.insertMulti(key, ValueType());
+}
+
+template<class KeyType, class ValueType, class Access>
+void insert(Utils::HashMap<KeyType, ValueType, Access>& map, const KeyType& key) {
+    map.insert(key, ValueType());
+}
+
+template<class KeyType, class ValueType, class Access>
+void insertMulti(Utils::HashMap<KeyType, ValueType, Access>& map, const KeyType& key) {
+    map.insertMulti(key, ValueType());
+}
+
+template<class KeyType, class Access>
+void reserve(Utils::TreeSet<KeyType, Access>&, size_t) {
+    // nothing
+}
+
+template<class KeyType, class ValueType, class Access>
+void reserve(Utils::TreeMap<KeyType, ValueType, Access>&, size_t) {
+    // nothing
+}
+
+template<class KeyType, class ValueType, class Access>
+void reserve(Utils::HashMap<KeyType, ValueType, Access>& map, size_t size) {
+    // HACK: performance (see HashInsertTest)
+    const size_t maxBuckets = 1048576;
+    map.reserve(std::min(size, maxBuckets));
+}
+
+/**
+ * Per-thread counters of one operation class
+ */
+struct OperationStats {
+    OperationStats() {
+        reset();
+    }
+
+    void reset() {
+        count = 0;
+        hits = 0;
+        changed = 0;
+        latency.reset();
+    }
+
+    void merge(const OperationStats& stats) {
+        count += stats.count;
+        hits += stats.hits;
+        changed += stats.changed;
+        latency.merge(stats.latency);
+    }
+
+    uint64_t count;
+    // lookups which found the key, inserts which added a new key,
+    // removals which erased something
+    uint64_t hits;
+    // elements added or erased
+    uint64_t changed;
+    Utils::Histogram latency;
+};
+
+} // namespace MixedWorkload
+
+/**
+ * Configurable mix of lookups and modifications over a prepopulated container.
+ *
+ * Options:
+ *   mix=find:45,contains:45,insert:5,removeAll:5 - weights of operations
+ *   prefill=50 - percent of keys inserted before the run
+ */
+template<class LockPolicy, class ContainerType>
+class MixedWorkloadTest: public SynchronizedTest<LockPolicy> {
+public:
+    static const bool INSTRUMENTED = true;
+
+    typedef ContainerType MyContainer;
+    typedef MixedWorkload::Operation Operation;
+
+    MixedWorkloadTest() {
+        const unsigned defaultMix[MixedWorkload::OP_MAX] = { 45, 45, 5, 0, 5 };
+        std::copy(defaultMix, defaultMix + MixedWorkload::OP_MAX, m_mix);
+        m_prefill = 50;
+        m_initialSize = 0;
+    }
+
+    virtual bool configure(const Options& options) {
+        if (!SynchronizedTest<LockPolicy>::configure(options)) {
+            return false;
+        }
+
+        Options::const_iterator it = options.find("mix");
+        if (it != options.end() && !parseMix(it->second)) {
+            std::cerr << "Invalid operations mix: " << it->second << std::endl;
+            return false;
+        }
+
+        it = options.find("prefill");
+        if (it != options.end()) {
+            m_prefill = strtoul(it->second.c_str(), NULL, 10);
+            if (m_prefill > 100) {
+                std::cerr << "Invalid prefill: " << it->second << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    virtual void generate(size_t inputSize, size_t threadsCount) {
+        SynchronizedTest<LockPolicy>::generate(inputSize, threadsCount);
+
+        if (m_operations.size() != this->m_inputSize) {
+            m_operations.resize(this->m_inputSize);
+            this->m_pool.run([this](size_t threadId) {
+                generateOperations(threadId);
+            });
+        }
+    }
+
+    virtual void setup() {
+        m_shared.clear();
+        MixedWorkload::reserve(m_shared, this->m_inputSize);
+
+        // deterministic subset of keys, independent of the input
+        for(size_t key = 0; key < this->m_inputSize; key++) {
+            if (Utils::Random::mix(key ^ this->m_seed) % 100 < m_prefill) {
+                MixedWorkload::insert(m_shared, static_cast<int>(key));
+            }
+        }
+
+        m_initialSize = elementsCount();
+    }
+
+    virtual void teardown() {
+        m_shared.clear();
+    }
+
+    virtual RunResult run() {
+        m_threadStats.resize(this->m_threadsCount);
+        for(size_t threadId = 0; threadId < this->m_threadsCount; threadId++) {
+            for(size_t op = 0; op < MixedWorkload::OP_MAX; op++) {
+                m_threadStats[threadId].ops[op].reset();
+            }
+        }
+
+        const RunResult result = SynchronizedTest<LockPolicy>::run();
+
+        for(size_t threadId = 0; threadId < this->m_threadsCount; threadId++) {
+            for(size_t op = 0; op < MixedWorkload::OP_MAX; op++) {
+                m_totals[op].merge(m_threadStats[threadId].ops[op]);
+            }
+        }
+
+        return result;
+    }
+
+#ifdef CONTAINER_HEATMAP
+    virtual Utils::Heatmap *heatmap() {
+        return &m_shared.heatmap();
+    }
+#endif
+
+    virtual bool containerStats(Utils::ContainerStats *stats) const {
+        *stats = m_shared.stats();
+        return true;
+    }
+
+    virtual bool check() {
+        // every element must be reachable by lookup
+        for(typename MyContainer::Iterator it = m_shared.begin(); it != m_shared.end(); it++) {
+            if (!m_shared.contains(it.key())) {
+                return false;
+            }
+        }
+
+        // and no modification may be lost
+        size_t expected = m_initialSize;
+        for(size_t threadId = 0; threadId < m_threadStats.size(); threadId++) {
+            const MixedWorkload::OperationStats *ops = m_threadStats[threadId].ops;
+            expected += ops[MixedWorkload::OP_INSERT].changed;
+            expected += ops[MixedWorkload::OP_INSERT_MULTI].changed;
+            expected -= ops[MixedWorkload::OP_REMOVE_ALL].changed;
+        }
+
+        return elementsCount() == expected;
+    }
+
+    virtual void report(std::ostream& out) const {
+        SynchronizedTest<LockPolicy>::report(out);
+
+        uint64_t total = 0;
+        for(size_t op = 0; op < MixedWorkload::OP_MAX; op++) {
+            total += m_totals[op].count;
+        }
+
+        for(size_t op = 0; op < MixedWorkload::OP_MAX; op++) {
+            const MixedWorkload::OperationStats& stats = m_totals[op];
+            if (stats.count == 0) {
+                continue;
+            }
+
+            out << "\t" << std::setw(12) << std::left << MixedWorkload::OPERATION_NAMES[op]
+                << stats.count << " ops, " << std::fixed << std::setprecision(1)
+                << 100.0 * stats.count / total << "% ops, "
+                << 100.0 * stats.hits / stats.count << "% hits, "
+                << "mean " << stats.latency.mean() << " ns, "
+                << "p50 " << stats.latency.percentile(50.0) << " ns, "
+                << "p99 " << stats.latency.percentile(99.0) << " ns" << std::endl;
+        }
+    }
+
+    virtual void clearResults() {
+        SynchronizedTest<LockPolicy>::clearResults();
+
+        for(size_t op = 0; op < MixedWorkload::OP_MAX; op++) {
+            m_totals[op].reset();
+        }
+    }
+
+protected:
+    virtual bool containerFingerprint(Utils::Fingerprint *result) {
+        *result = this->fingerprint(m_shared);
+        return true;
+    }
+
+    size_t elementsCount() const {
+        size_t count = 0;
+        for(typename MyContainer::Iterator it = m_shared.begin(); it != m_shared.end(); it++) {
+            count++;
+        }
+
+        return count;
+    }
+
+    bool parseMix(const std::string& spec) {
+        unsigned mix[MixedWorkload::OP_MAX] = { 0 };
+        unsigned sum = 0;
+
+        std::istringstream stream(spec);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            const size_t colon = item.find(':');
+            if (colon == std::string::npos) {
+                return false;
+            }
+
+            const std::string name = item.substr(0, colon);
+            size_t op = 0;
+            while (op < MixedWorkload::OP_MAX && name != MixedWorkload::OPERATION_NAMES[op]) {
+                op++;
+            }
+
+            if (op == MixedWorkload::OP_MAX) {
+                return false;
+            }
+
+            mix[op] = strtoul(item.substr(colon + 1).c_str(), NULL, 10);
+            sum += mix[op];
+        }
+
+        if (sum == 0) {
+            return false;
+        }
+
+        std::copy(mix, mix + MixedWorkload::OP_MAX, m_mix);
+        return true;
+    }
+
+    void generateOperations(size_t threadId) {
+        unsigned sum = 0;
+        for(size_t op = 0; op < MixedWorkload::OP_MAX; op++) {
+            sum += m_mix[op];
+        }
+
+        const size_t blockSize = NumbersTest::GENERATE_BLOCK_SIZE;
+        const size_t blocksCount = (this->m_inputSize + blockSize - 1) / blockSize;
+        for(size_t block = threadId; block < blocksCount; block += this->m_threadsCount) {
+            // streams of keys use the lower half of the stream space
+            Utils::Random random(this->m_seed, ((uint64_t) 1 << 63) | block);
+
+            const size_t start = block * blockSize;
+            const size_t end = std::min(start + blockSize, this->m_inputSize);
+            for(size_t i = start; i < end; i++) {
+                unsigned value = random.uniform(sum);
+                size_t op = 0;
+                while (value >= m_mix[op]) {
+                    value -= m_mix[op];
+                    op++;
+                }
+
+                m_operations[i] = static_cast<unsigned char>(op);
+            }
+        }
+    }
+
+    virtual void worker(size_t start, size_t end) {
+        ThreadStats& stats = m_threadStats[Utils::ThreadPool::threadId()];
+
+        for(size_t i = start; i < end; i++) {
+            const int key = this->m_input[i];
+            const size_t op = m_operations[i];
+            bool hit = false;
+            size_t changed = 0;
+            uint64_t latency = 0;
+
+            switch (op) {
+            case MixedWorkload::OP_FIND:
+                latency = this->criticalSection([&]() {
+                    hit = (m_shared.find(key) != m_shared.end());
+                });
+                break;
+            case MixedWorkload::OP_CONTAINS:
+                latency = this->criticalSection([&]() {
+                    hit = m_shared.contains(key);
+                });
+                break;
+            case MixedWorkload::OP_INSERT:
+                latency = this->criticalSection([&]() {
+                    // insert() of an existing key only updates it
+                    hit = !m_shared.contains(key);
+                    MixedWorkload::insert(m_shared, key);
+                });
+                changed = hit ? 1 : 0;
+                break;
+            case MixedWorkload::OP_INSERT_MULTI:
+                latency = this->criticalSection([&]() {
+                    MixedWorkload::insertMulti(m_shared, key);
+                });
+                hit = true;
+                changed = 1;
+                break;
+            case MixedWorkload::OP_REMOVE_ALL:
+                latency = this->criticalSection([&]() {
+                    changed = m_shared.count(key);
+                    m_shared.removeAll(key);
+                });
+                hit = (changed > 0);
+                break;
+            }
+
+            stats.ops[op].count++;
+            stats.ops[op].changed += changed;
+            stats.ops[op].latency.record(latency);
+            if (hit) {
+                stats.ops[op].hits++;
+            }
+        }
+    }
+
+    struct ThreadStats {
+        MixedWorkload::OperationStats ops[MixedWorkload::OP_MAX];
+    };
+
+    unsigned m_mix[MixedWorkload::OP_MAX];
+    unsigned m_prefill;
+    std::vector<unsigned char> m_operations;
+
+    std::vector<ThreadStats> m_threadStats;
+    MixedWorkload::OperationStats m_totals[MixedWorkload::OP_MAX];
+    // elements after setup()
+    size_t m_initialSize;
+
+    MyContainer m_shared;
+};
+
+template<class LockPolicy>
+using MixedTreeSetTest = MixedWorkloadTest<LockPolicy,
+        Utils::TreeSet<int, typename LockPolicy::Access> >;
+
+template<class LockPolicy>
+using MixedTreeMapTest = MixedWorkloadTest<LockPolicy,
+        Utils::TreeMap<int, int, typename LockPolicy::Access> >;
+
+template<class LockPolicy>
+using MixedHashMapTest = MixedWorkloadTest<LockPolicy,
+        Utils::HashMap<int, int, typename LockPolicy::Access> >;
+
+#endif // MIXEDWORKLOADTEST_H
@@ -32,25 +32,203 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <unistd.h>
+#include <string.h>
 #include <iostream>
-#include <random>
+#include <string>
+#include <map>
+#include <vector>
+#include <cstdlib>
 #include <algorithm>
+#include <functional>
+#include <chrono>
+#include <atomic>
 #include <thread>
-#ifdef LOCKTYPE_MUTEX
-#include <mutex>
-#endif
 
 #include "../Common.h"
+#include <Utils/ThreadPool.h>
+#include <Utils/PerfCounters.h>
+#include <Utils/Histogram.h>
+#include <Utils/Random.h>
+#include <Utils/KeyDistribution.h>
+#include <Utils/Fingerprint.h>
+#include <Utils/InputBuffer.h>
+#include <Utils/ContainerStats.h>
+#include <Utils/Heatmap.h>
+#include <Utils/Timer.h>
+#include <Utils/CacheFlusher.h>
+
+/**
+ * Optional key=value parameters of a config line
+ */
+typedef std::map<std::string, std::string> Options;
+
+/**
+ * Parse duration like "10s", "500ms" or "2m".
+ * Returns false if the value is invalid.
+ */
+static inline bool parseDuration(const std::string& value, std::chrono::nanoseconds *result) {
+    char *end = NULL;
+    const double number = strtod(value.c_str(), &end);
+    const std::string unit(end);
+
+    double ns = 0.0;
+    if (unit == "ms") {
+        ns = number * 1e6;
+    } else if (unit == "s" || unit.empty()) {
+        ns = number * 1e9;
+    } else if (unit == "m") {
+        ns = number * 60e9;
+    } else {
+        return false;
+    }
+
+    if (end == value.c_str() || ns <= 0.0) {
+        return false;
+    }
+
+    *result = std::chrono::nanoseconds(static_cast<int64_t>(ns));
+    return true;
+}
+
+/**
+ * Distribution of the input between threads
+ */
+struct Schedule {
+    enum Type {
+        // one contiguous range per thread
+        STATIC,
+        // chunks of fixed size taken from a shared counter
+        DYNAMIC,
+        // chunks proportional to the remaining input, but not smaller than chunk
+        GUIDED
+    };
+
+    Schedule() {
+        type = STATIC;
+        chunk = 0;
+    }
+
+    Type type;
+    size_t chunk;
+};
+
+/**
+ * Parse static, dynamic[:CHUNK] or guided[:MIN_CHUNK]
+ */
+static inline bool parseSchedule(const std::string& str, Schedule *result) {
+    const size_t colon = str.find(':');
+    const std::string name = str.substr(0, colon);
+
+    Schedule schedule;
+    if (name == "static") {
+        schedule.type = Schedule::STATIC;
+    } else if (name == "dynamic") {
+        schedule.type = Schedule::DYNAMIC;
+        schedule.chunk = 256;
+    } else if (name == "guided") {
+        schedule.type = Schedule::GUIDED;
+        schedule.chunk = 16;
+    } else {
+        return false;
+    }
+
+    if (colon != std::string::npos) {
+        char *end;
+        const std::string value = str.substr(colon + 1);
+        schedule.chunk = strtoul(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0' || schedule.chunk == 0 ||
+                schedule.type == Schedule::STATIC) {
+            return false;
+        }
+    }
+
+    *result = schedule;
+    return true;
+}
+
+/**
+ * Measured part of a test run
+ */
+struct RunResult {
+    RunResult() {
+        elapsed = std::chrono::nanoseconds(0);
+        operations = 0;
+        complete = true;
+        busyCycles = 0;
+    }
+
+    std::chrono::nanoseconds elapsed;
+    uint64_t operations;
+    // input was processed exactly once, so check() is meaningful
+    bool complete;
+    // operations done by each thread during the whole run
+    std::vector<uint64_t> threadOperations;
+    // time spent by each thread in worker() and its finish time
+    // relative to the start of the run
+    std::vector<std::chrono::nanoseconds> threadBusy;
+    std::vector<std::chrono::nanoseconds> threadFinish;
+    // TSC cycles spent by all threads in worker()
+    uint64_t busyCycles;
+    // critical sections of each thread (only with CRITICAL_SECTION_STATS)
+    std::vector<Locks::SectionStats> threadSections;
+    // transactions of all threads (TM backend only)
+    Locks::TMStats transactions;
+    // performance events of all threads, if requested
+    Utils::PerfCounters::Values counters;
+    std::string countersError;
+};
 
 struct ITest {
+    /**
+     * Returns false if some option has an invalid value
+     */
+    virtual bool configure(const Options& options) = 0;
+
     virtual void generate(size_t inputSize, size_t threadsCount) = 0;
 
     virtual void setup() = 0;
-    virtual void run() = 0;
+    /**
+     * Bring caches into the state requested by the cache= option,
+     * called between setup() and run()
+     */
+    virtual void prepareCaches() = 0;
+    /**
+     * Returns the duration and operations count of the measured part of the run
+     */
+    virtual RunResult run() = 0;
     virtual void teardown() = 0;
 
     virtual bool check()  = 0;
 
+    /**
+     * Latencies of critical sections (ns) recorded during the last run
+     * or NULL if the test doesn't record them
+     */
+    virtual const Utils::Histogram *latency() const = 0;
+
+    /**
+     * Contention heatmap of the shared container or NULL if the test
+     * doesn't have it (see CONTAINER_HEATMAP in Utils/Heatmap.h)
+     */
+    virtual Utils::Heatmap *heatmap() = 0;
+
+    /**
+     * Fill stats of the shared container after the run,
+     * returns false if the test doesn't have one
+     */
+    virtual bool containerStats(Utils::ContainerStats *stats) const = 0;
+
+    /**
+     * Print test-specific results accumulated over all runs
+     */
+    virtual void report(std::ostream& out) const = 0;
+
+    /**
+     * Discard results accumulated for report() (e.g. after warm-up runs)
+     */
+    virtual void clearResults() = 0;
+
     virtual ~ITest() {
 
     }
@@ -58,6 +236,19 @@ struct ITest {
 
 class AbstractTest: public ITest {
 public:
+    AbstractTest() {
+        m_seed = 0;
+    }
+
+    virtual bool configure(const Options& options) {
+        Options::const_iterator it = options.find("seed");
+        if (it != options.end()) {
+            m_seed = strtoull(it->second.c_str(), NULL, 0);
+        }
+
+        return true;
+    }
+
     virtual void generate(size_t inputSize, size_t threadsCount) {
         m_inputSize = inputSize;
         m_threadsCount = threadsCount;
@@ -67,7 +258,11 @@ public:
         // nothing
     }
 
-    virtual void run() = 0;
+    virtual void prepareCaches() {
+        // nothing
+    }
+
+    virtual RunResult run() = 0;
 
     virtual void teardown() {
         // nothing
@@ -75,20 +270,119 @@ public:
 
     virtual bool check()  = 0;
 
+    virtual const Utils::Histogram *latency() const {
+        return NULL;
+    }
+
+    virtual Utils::Heatmap *heatmap() {
+        return NULL;
+    }
+
+    virtual bool containerStats(Utils::ContainerStats *stats) const {
+        return false;
+    }
+
+    virtual void report(std::ostream& out) const {
+        // nothing
+    }
+
+    virtual void clearResults() {
+        // nothing
+    }
+
 protected:
     size_t m_inputSize;
     size_t m_threadsCount;
-    std::random_device m_rnd;
+    uint64_t m_seed;
 };
 
 class NumbersTest: public AbstractTest {
 public:
+    NumbersTest() {
+        m_generatedSeed = 0;
+        m_duration = std::chrono::nanoseconds(0);
+        m_sampleInterval = std::chrono::milliseconds(100);
+        m_perf = false;
+        m_sortCheck = false;
+        m_cacheMode = CACHE_DEFAULT;
+        m_flushSize = 0;
+    }
+
+    virtual bool configure(const Options& options) {
+        if (!AbstractTest::configure(options)) {
+            return false;
+        }
+
+        Options::const_iterator it = options.find("dist");
+        if (it != options.end() && !m_distribution.parse(it->second)) {
+            std::cerr << "Invalid distribution: " << it->second << std::endl;
+            return false;
+        }
+
+        it = options.find("duration");
+        if (it != options.end() && !parseDuration(it->second, &m_duration)) {
+            std::cerr << "Invalid duration: " << it->second << std::endl;
+            return false;
+        }
+
+        it = options.find("sample");
+        if (it != options.end() && !parseDuration(it->second, &m_sampleInterval)) {
+            std::cerr << "Invalid sample interval: " << it->second << std::endl;
+            return false;
+        }
+
+        it = options.find("schedule");
+        if (it != options.end() && !parseSchedule(it->second, &m_schedule)) {
+            std::cerr << "Invalid schedule: " << it->second << std::endl;
+            return false;
+        }
+
+        it = options.find("check");
+        if (it != options.end() && it->second != "fingerprint" && it->second != "sort") {
+            std::cerr << "Invalid check: " << it->second << std::endl;
+            return false;
+        }
+        m_sortCheck = (it != options.end() && it->second == "sort");
+
+        it = options.find("input");
+        m_inputPath = (it != options.end()) ? it->second : "";
+
+        it = options.find("perf");
+        m_perf = (it != options.end() && it->second != "0");
+
+        m_cacheMode = CACHE_DEFAULT;
+        it = options.find("cache");
+        if (it != options.end() && !parseCacheMode(it->second)) {
+            std::cerr << "Invalid cache mode: " << it->second << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
     virtual void generate(size_t inputSize, size_t threadsCount)
     {
         AbstractTest::generate(inputSize, threadsCount);
-        m_input.resize(m_inputSize);
-        for(size_t i = 0; i < m_inputSize; i++) {
-            m_input[i] = m_rnd() % inputSize;
+
+        // workers live for the whole test and are parked between runs
+        m_pool.resize(m_threadsCount);
+
+        // the input depends only on seed, size and distribution,
+        // reuse it between runs
+        if (m_input.size() != m_inputSize || m_generatedSeed != m_seed ||
+                m_generatedDistribution != m_distribution.toString()) {
+            m_distribution.setRange(m_inputSize);
+            if (m_inputPath.empty() || !loadInput()) {
+                generateInput();
+
+                // existing files are never overwritten
+                if (!m_inputPath.empty() && access(m_inputPath.c_str(), F_OK) != 0) {
+                    saveInput();
+                }
+            }
+
+            m_generatedSeed = m_seed;
+            m_generatedDistribution = m_distribution.toString();
         }
 
         const size_t keysPerThread = m_inputSize / m_threadsCount;
@@ -103,29 +397,570 @@ public:
         m_ranges[m_threadsCount-1].second = m_inputSize;
     }
 
-    virtual void run() {
-        std::vector<std::thread> threads;
-        threads.resize(m_threadsCount);
+    virtual void prepareCaches() {
+        if (m_cacheMode == CACHE_COLD) {
+            Utils::CacheFlusher& flusher = cacheFlusher();
+            if (!flusher.resize(m_flushSize)) {
+                std::cerr << "Can't allocate " << m_flushSize
+                          << " bytes to flush caches" << std::endl;
+                return;
+            }
+
+            m_pool.run([&](size_t threadId) {
+                flusher.stream(threadId, m_threadsCount);
+            });
+            Utils::CacheFlusher::clflush(m_input.begin(),
+                                         m_input.size() * sizeof(*m_input.begin()));
+        } else if (m_cacheMode == CACHE_WARM) {
+            // every thread reads keys of its static range
+            m_pool.run([this](size_t threadId) {
+                int64_t sum = 0;
+                for(size_t i = m_ranges[threadId].first; i < m_ranges[threadId].second; i++) {
+                    sum += m_input[i];
+                }
 
+                volatile int64_t sink = sum;
+                (void) sink;
+            });
+
+            // and the shared container, by all threads where its forEach()
+            // splits it into parts (a linked list is read by one thread)
+            Utils::Fingerprint contents;
+            containerFingerprint(&contents);
+        }
+    }
+
+    virtual RunResult run() {
+        m_threadLatencies.resize(m_threadsCount);
+        for(size_t threadId = 0; threadId < m_threadsCount; threadId++) {
+            m_threadLatencies[threadId].reset();
+        }
+
+        m_nextChunk.store(0);
+        m_counters.assign(m_threadsCount, Counter());
+        m_busy.assign(m_threadsCount, Counter());
+        m_sections.assign(m_threadsCount, Locks::SectionStats());
+        m_transactions.assign(m_threadsCount, Locks::TMStats());
+
+        // only the measured part is counted
+        m_pool.setPerfCounters(m_perf);
+
+        RunResult result;
+        if (m_duration.count() == 0) {
+            result.elapsed = m_pool.run([this](size_t threadId) {
+                scheduledWorker(threadId);
+            });
+            result.operations = m_inputSize;
+        } else {
+            result = runTimed();
+        }
+
+        result.threadFinish = m_pool.finishTimes();
+        for(size_t threadId = 0; threadId < m_threadsCount; threadId++) {
+            result.threadOperations.push_back(m_counters[threadId].value.load());
+            const uint64_t busy = m_busy[threadId].value.load();
+            result.threadBusy.push_back(std::chrono::nanoseconds(
+                                            Utils::Timer::instance().toNs(busy)));
+            result.busyCycles += busy;
+        }
+        result.threadSections = m_sections;
         for(size_t threadId = 0; threadId < m_threadsCount; threadId++) {
-            threads[threadId] = std::thread(std::bind( &NumbersTest::worker,
-                    this, m_ranges[threadId].first, m_ranges[threadId].second));
+            result.transactions.merge(m_transactions[threadId]);
         }
 
+        m_pool.setPerfCounters(false);
+        if (m_perf) {
+            for(size_t threadId = 0; threadId < m_threadsCount; threadId++) {
+                result.counters.merge(m_pool.perfCounters()[threadId]);
+            }
+            result.countersError = m_pool.perfError();
+        }
+
+        m_latency.reset();
         for(size_t threadId = 0; threadId < m_threadsCount; threadId++) {
-            threads[threadId].join();
+            m_latency.merge(m_threadLatencies[threadId]);
         }
+
+        return result;
+    }
+
+    virtual void report(std::ostream& out) const {
+        for(size_t run = 0; run < m_series.size(); run++) {
+            const Series& series = m_series[run];
+
+            out << "\tRun " << run + 1 << " throughput (ops/ms every "
+                << m_sampleInterval.count() * 1e-6 << " ms):";
+            for(size_t i = 0; i < series.rates.size(); i++) {
+                out << " " << static_cast<uint64_t>(series.rates[i]);
+            }
+
+            out << std::endl << "\t\twarm-up " << series.warmupMs << " ms, steady state "
+                << series.steadyRate << " ops/ms, drift "
+                << series.drift << "%" << std::endl;
+        }
+    }
+
+    virtual void clearResults() {
+        m_series.clear();
+    }
+
+    virtual const Utils::Histogram *latency() const {
+        return &m_latency;
     }
 
 protected:
-#ifdef LOCKTYPE_MUTEX
-    std::mutex lock;
-#endif
+    /*
+     * Input is generated by fixed-size blocks, each block has its own
+     * random stream, so the result doesn't depend on threads count
+     */
+    static const size_t GENERATE_BLOCK_SIZE = 65536;
+
+    void generateInput() {
+        m_input.resize(m_inputSize);
+        std::vector<Utils::Fingerprint> fingerprints(m_threadsCount);
+        m_pool.run([&](size_t threadId) {
+            generateBlocks(threadId, &fingerprints[threadId]);
+        });
+
+        m_inputFingerprint = Utils::Fingerprint();
+        for(size_t threadId = 0; threadId < m_threadsCount; threadId++) {
+            m_inputFingerprint.merge(fingerprints[threadId]);
+        }
+    }
+
+    /**
+     * Map the input file if it has been generated with the same parameters
+     */
+    bool loadInput() {
+        Utils::InputBuffer::Header header;
+        if (!m_input.load(m_inputPath, &header)) {
+            return false;
+        }
+
+        if (header.seed != m_seed || header.count != m_inputSize ||
+                m_distribution.toString() != header.distribution) {
+            std::cerr << "Input file " << m_inputPath << " has different parameters (seed "
+                      << header.seed << ", size " << header.count << ", distribution "
+                      << header.distribution << "), generating the input" << std::endl;
+            return false;
+        }
+
+        m_inputFingerprint = header.fingerprint;
+        return true;
+    }
+
+    void saveInput() {
+        Utils::InputBuffer::Header header;
+        header.seed = m_seed;
+        header.count = m_inputSize;
+        strncpy(header.distribution, m_distribution.toString().c_str(),
+                sizeof(header.distribution) - 1);
+        header.fingerprint = m_inputFingerprint;
+
+        if (!m_input.save(m_inputPath, header)) {
+            std::cerr << "Can't write input file " << m_inputPath << std::endl;
+        }
+    }
+
+    void generateBlocks(size_t threadId, Utils::Fingerprint *fingerprint) {
+        const size_t blocksCount = (m_inputSize + GENERATE_BLOCK_SIZE - 1) / GENERATE_BLOCK_SIZE;
+        for(size_t block = threadId; block < blocksCount; block += m_threadsCount) {
+            Utils::Random random(m_seed, block);
+
+            const size_t start = block * GENERATE_BLOCK_SIZE;
+            const size_t end = std::min(start + GENERATE_BLOCK_SIZE, m_inputSize);
+            int *input = m_input.data();
+            for(size_t i = start; i < end; i++) {
+                input[i] = m_distribution(random, i);
+                fingerprint->add(input[i]);
+            }
+        }
+    }
 
     virtual void worker(size_t start, size_t end) = 0;
 
-    std::vector<int> m_input;
+    /**
+     * Fingerprint of the shared container (see fingerprint()), returns
+     * false if the test has no container
+     */
+    virtual bool containerFingerprint(Utils::Fingerprint *result) {
+        return false;
+    }
+
+    /**
+     * "cold[:MB]" - flush caches with a buffer of MB megabytes
+     * (twice the last level cache by default), "warm" - read the data
+     * before the run, "default" - leave caches as setup() left them
+     */
+    bool parseCacheMode(const std::string& value) {
+        if (value == "default") {
+            m_cacheMode = CACHE_DEFAULT;
+        } else if (value == "warm") {
+            m_cacheMode = CACHE_WARM;
+        } else if (value.compare(0, 4, "cold") == 0) {
+            m_cacheMode = CACHE_COLD;
+            m_flushSize = 2 * Utils::CacheFlusher::lastLevelSize();
+            if (value.size() > 4) {
+                char *end;
+                const double megabytes = strtod(value.c_str() + 5, &end);
+                if (value[4] != ':' || *end != '\0' || megabytes <= 0.0) {
+                    return false;
+                }
+
+                m_flushSize = static_cast<size_t>(megabytes * 1024 * 1024);
+            }
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Shared by all tests, the buffer is kept between runs
+     */
+    static Utils::CacheFlusher& cacheFlusher() {
+        static Utils::CacheFlusher flusher;
+        return flusher;
+    }
+
+    /**
+     * Fingerprint of the container contents computed by all threads,
+     * see forEach() of containers
+     */
+    template<class Container>
+    Utils::Fingerprint fingerprint(const Container& container) {
+        std::vector<Utils::Fingerprint> fingerprints(m_threadsCount);
+        m_pool.run([&](size_t threadId) {
+            container.forEach(threadId, m_threadsCount,
+                              Utils::Fingerprint::Collector(&fingerprints[threadId]));
+        });
+
+        Utils::Fingerprint result;
+        for(size_t threadId = 0; threadId < m_threadsCount; threadId++) {
+            result.merge(fingerprints[threadId]);
+        }
+
+        return result;
+    }
+
+    /*
+     * Fixed-duration mode: every worker loops over its range by chunks
+     * until the monitor sets the stop flag
+     */
+    static const size_t TIMED_CHUNK_SIZE = 256;
+
+    struct Counter {
+        Counter() {
+            value.store(0);
+        }
+
+        Counter(const Counter& counter) {
+            value.store(counter.value.load());
+        }
+
+        Counter& operator=(const Counter& counter) {
+            value.store(counter.value.load());
+            return *this;
+        }
+
+        std::atomic<uint64_t> value;
+        // avoid false sharing
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    /**
+     * Throughput time series of one run
+     */
+    struct Series {
+        std::vector<double> rates;
+        double warmupMs;
+        double steadyRate;
+        double drift;
+    };
+
+    RunResult runTimed() {
+        m_stop.store(false);
+
+        std::vector<uint64_t> ops;
+        std::vector<double> ms;
+
+        m_pool.run([this](size_t threadId) {
+            timedWorker(threadId);
+        }, [&]() {
+            typedef std::chrono::steady_clock Clock;
+            const Clock::time_point start = Clock::now();
+            Clock::time_point prevTime = start;
+            uint64_t prevOps = 0;
+
+            for(size_t sample = 1; prevTime - start < m_duration; sample++) {
+                std::this_thread::sleep_until(start + sample * m_sampleInterval);
+
+                uint64_t totalOps = 0;
+                for(size_t threadId = 0; threadId < m_threadsCount; threadId++) {
+                    totalOps += m_counters[threadId].value.load(std::memory_order_relaxed);
+                }
+
+                const Clock::time_point now = Clock::now();
+                ops.push_back(totalOps - prevOps);
+                ms.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 now - prevTime).count() * 1e-6);
+                prevOps = totalOps;
+                prevTime = now;
+            }
+
+            m_stop.store(true);
+        });
+
+        Series series;
+        for(size_t i = 0; i < ops.size(); i++) {
+            series.rates.push_back(ops[i] / ms[i]);
+        }
+
+        // summary covers only the steady-state window
+        const size_t steady = steadyStateStart(series.rates);
+
+        RunResult result;
+        result.complete = false;
+        double steadyMs = 0.0;
+        series.warmupMs = 0.0;
+        for(size_t i = 0; i < ops.size(); i++) {
+            if (i < steady) {
+                series.warmupMs += ms[i];
+            } else {
+                result.operations += ops[i];
+                steadyMs += ms[i];
+            }
+        }
+
+        result.elapsed = std::chrono::nanoseconds(static_cast<int64_t>(steadyMs * 1e6));
+        series.steadyRate = (steadyMs > 0.0) ? result.operations / steadyMs : 0.0;
+
+        // throughput change between the first and the last third of the window
+        const size_t third = (series.rates.size() - steady) / 3;
+        series.drift = 0.0;
+        if (third > 0) {
+            double first = 0.0, last = 0.0;
+            for(size_t i = 0; i < third; i++) {
+                first += series.rates[steady + i];
+                last += series.rates[series.rates.size() - 1 - i];
+            }
+
+            series.drift = (first > 0.0) ? 100.0 * (last - first) / first : 0.0;
+        }
+
+        m_series.push_back(series);
+        return result;
+    }
+
+    /**
+     * First sample of the steady state: the one after which throughput
+     * stays within 10% of the median of the second half of the run
+     */
+    static size_t steadyStateStart(const std::vector<double>& rates) {
+        const size_t window = 3;
+        if (rates.size() <= window) {
+            return 0;
+        }
+
+        std::vector<double> tail(rates.begin() + rates.size() / 2, rates.end());
+        std::nth_element(tail.begin(), tail.begin() + tail.size() / 2, tail.end());
+        const double reference = tail[tail.size() / 2];
+        const double tolerance = 0.1 * reference;
+
+        for(size_t i = 0; i + window <= rates.size(); i++) {
+            bool stable = true;
+            for(size_t j = i; j < i + window; j++) {
+                if (fabs(rates[j] - reference) > tolerance) {
+                    stable = false;
+                    break;
+                }
+            }
+
+            if (stable) {
+                return i;
+            }
+        }
+
+        return rates.size() / 2;
+    }
+
+    /**
+     * Take the next chunk of the input according to the schedule,
+     * returns false if the input is exhausted
+     */
+    bool nextChunk(size_t *start, size_t *end) {
+        if (m_schedule.type == Schedule::DYNAMIC) {
+            *start = m_nextChunk.fetch_add(m_schedule.chunk, std::memory_order_relaxed);
+            *end = std::min(*start + m_schedule.chunk, m_inputSize);
+            return *start < m_inputSize;
+        }
+
+        size_t current = m_nextChunk.load(std::memory_order_relaxed);
+        while (current < m_inputSize) {
+            const size_t size = std::max(m_schedule.chunk,
+                                         (m_inputSize - current) / (2 * m_threadsCount));
+            if (m_nextChunk.compare_exchange_weak(current, current + size,
+                                                  std::memory_order_relaxed)) {
+                *start = current;
+                *end = std::min(current + size, m_inputSize);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Process the input once: own range or chunks from the shared counter
+     */
+    void scheduledWorker(size_t threadId) {
+        uint64_t ops = 0;
+        uint64_t busy = 0;
+        Locks::SectionStats::current().reset();
+        Locks::TMStats::current().reset();
+        auto process = [&](size_t start, size_t end) {
+            const uint64_t chunkStart = Utils::Timer::cycles();
+            worker(start, end);
+            busy += Utils::Timer::cyclesAfter() - chunkStart;
+            ops += end - start;
+        };
+
+        if (m_schedule.type == Schedule::STATIC) {
+            process(m_ranges[threadId].first, m_ranges[threadId].second);
+        } else {
+            size_t start, end;
+            while (nextChunk(&start, &end)) {
+                process(start, end);
+            }
+        }
+
+        m_counters[threadId].value.store(ops);
+        m_busy[threadId].value.store(busy);
+        m_sections[threadId] = Locks::SectionStats::current();
+        Locks::TMStats::current().finish();
+        m_transactions[threadId] = Locks::TMStats::current();
+    }
+
+    void timedWorker(size_t threadId) {
+        const size_t start = m_ranges[threadId].first;
+        const size_t end = m_ranges[threadId].second;
+        if (m_schedule.type == Schedule::STATIC && start == end) {
+            return;
+        }
+
+        // chunks are taken from the shared counter modulo input size
+        // for non-static schedules
+        const size_t chunkSize = (m_schedule.type == Schedule::STATIC) ?
+                    TIMED_CHUNK_SIZE : m_schedule.chunk;
+
+        uint64_t ops = 0;
+        uint64_t busy = 0;
+        Locks::SectionStats::current().reset();
+        Locks::TMStats::current().reset();
+        size_t current = start;
+        while (!m_stop.load(std::memory_order_relaxed)) {
+            size_t chunkStart = current;
+            size_t chunkEnd = std::min(current + chunkSize, end);
+            if (m_schedule.type != Schedule::STATIC) {
+                chunkStart = m_nextChunk.fetch_add(chunkSize, std::memory_order_relaxed) %
+                        m_inputSize;
+                chunkEnd = std::min(chunkStart + chunkSize, m_inputSize);
+            }
+
+            const uint64_t workStart = Utils::Timer::cycles();
+            worker(chunkStart, chunkEnd);
+            busy += Utils::Timer::cyclesAfter() - workStart;
+
+            ops += chunkEnd - chunkStart;
+            m_counters[threadId].value.store(ops, std::memory_order_relaxed);
+            current = (chunkEnd == end) ? start : chunkEnd;
+        }
+
+        m_busy[threadId].value.store(busy);
+        m_sections[threadId] = Locks::SectionStats::current();
+        Locks::TMStats::current().finish();
+        m_transactions[threadId] = Locks::TMStats::current();
+    }
+
+    Utils::InputBuffer m_input;
+    // binary input file, empty if the input is only generated in memory
+    std::string m_inputPath;
+    Utils::Fingerprint m_inputFingerprint;
+    // check() sorts the input and the contents instead of fingerprinting
+    bool m_sortCheck;
     std::vector< std::pair<size_t, size_t> > m_ranges;
+    Utils::KeyDistribution m_distribution;
+    uint64_t m_generatedSeed;
+    std::string m_generatedDistribution;
+
+    Utils::ThreadPool m_pool;
+
+    // per-thread latencies are merged after the run
+    std::vector<Utils::Histogram> m_threadLatencies;
+    Utils::Histogram m_latency;
+
+    std::chrono::nanoseconds m_duration;
+    std::chrono::nanoseconds m_sampleInterval;
+    bool m_perf;
+    enum CacheMode { CACHE_DEFAULT, CACHE_COLD, CACHE_WARM };
+    CacheMode m_cacheMode;
+    size_t m_flushSize;
+    Schedule m_schedule;
+    std::atomic<size_t> m_nextChunk;
+    std::atomic<bool> m_stop;
+    // operations and busy time (TSC cycles) of each thread
+    std::vector<Counter> m_counters;
+    std::vector<Counter> m_busy;
+    std::vector<Locks::SectionStats> m_sections;
+    std::vector<Locks::TMStats> m_transactions;
+    std::vector<Series> m_series;
+};
+
+/**
+ * NumbersTest with a critical section implemented by LockPolicy
+ * (see Common.h)
+ */
+template<class LockPolicyParam>
+class SynchronizedTest: public NumbersTest {
+public:
+    /**
+     * Critical sections touch shared data only through containers
+     * parameterized by LockPolicy::Access (required by the stm backend)
+     */
+    static const bool INSTRUMENTED = false;
+
+    virtual bool configure(const Options& options) {
+        return NumbersTest::configure(options) && m_lock.configure(options);
+    }
+
+    virtual RunResult run() {
+        m_lock.start(m_threadsCount);
+        const RunResult result = NumbersTest::run();
+        m_lock.stop();
+        return result;
+    }
+
+protected:
+    typedef LockPolicyParam LockPolicy;
+
+    /**
+     * Execute function inside of the critical section, record and return
+     * its latency (ns). The default file and line are those of the caller.
+     */
+    template<class Function>
+    uint64_t criticalSection(Function function, const char *file = __builtin_FILE(),
+                             int line = __builtin_LINE()) {
+        const uint64_t t0 = Utils::Timer::cycles();
+        Locks::executeAt(m_lock, function, file, line);
+        const uint64_t t1 = Utils::Timer::cyclesAfter();
+
+        const uint64_t latency = Utils::Timer::instance().toNs(t1 - t0);
+        m_threadLatencies[Utils::ThreadPool::threadId()].record(latency);
+        return latency;
+    }
+
+    LockPolicy m_lock;
 };
 
 
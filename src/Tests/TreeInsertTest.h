@@ -36,9 +36,12 @@
 
 #include <Utils/TreeSet.h>
 
-class TreeInsertTest: public NumbersTest {
+template<class LockPolicy>
+class TreeInsertTest: public SynchronizedTest<LockPolicy> {
 public:
-    typedef Utils::TreeSet<int> MySet;
+    static const bool INSTRUMENTED = true;
+
+    typedef Utils::TreeSet<int, typename LockPolicy::Access> MySet;
 
     virtual void setup() {
         m_sharedSet.clear();
@@ -48,13 +51,41 @@ public:
         m_sharedSet.clear();
     }
 
+#ifdef CONTAINER_HEATMAP
+    virtual Utils::Heatmap *heatmap() {
+        return &m_sharedSet.heatmap();
+    }
+#endif
+
+    virtual bool containerStats(Utils::ContainerStats *stats) const {
+        *stats = m_sharedSet.stats();
+        return true;
+    }
+
     virtual bool check() {
-        std::vector<int> inputSorted(m_input);
+        if (this->m_sortCheck) {
+            return sortCheck();
+        }
+
+        return this->fingerprint(m_sharedSet) == this->m_inputFingerprint;
+    }
+
+protected:
+    virtual bool containerFingerprint(Utils::Fingerprint *result) {
+        *result = this->fingerprint(m_sharedSet);
+        return true;
+    }
+
+    /**
+     * Full check, enabled by check=sort
+     */
+    bool sortCheck() {
+        std::vector<int> inputSorted(this->m_input.begin(), this->m_input.end());
 
         size_t i = 0;
         std::sort(inputSorted.begin(), inputSorted.end());
 
-        for (MySet::Iterator it = m_sharedSet.begin(); it != m_sharedSet.end(); it++) {
+        for (typename MySet::Iterator it = m_sharedSet.begin(); it != m_sharedSet.end(); it++) {
             const int srcKey = inputSorted[i];
             const int setKey = it.key();
 
@@ -65,14 +96,13 @@ public:
             i++;
         }
 
-        return true;
+        return i == inputSorted.size();
     }
 
-protected:
     virtual void worker(size_t start, size_t end) {
         for(size_t i = start; i < end; i++) {
             BEGIN_CRITICAL_SECTION();
-                m_sharedSet.insertMulti(m_input[i]);
+                m_sharedSet.insertMulti(this->m_input[i]);
             END_CRITICAL_SECTION();
         }
     }
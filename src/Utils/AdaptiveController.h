@@ -0,0 +1,331 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef ADAPTIVECONTROLLER_H
+#define ADAPTIVECONTROLLER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include <Utils/SpinLocks.h>
+#include <Utils/Timer.h>
+
+namespace Utils {
+
+/**
+ * Chooses between transactions and a lock for every critical section
+ * site (see Locks::Adaptive in Common.h).
+ *
+ * Threads count executions of a site in their own windows of
+ * WINDOW_OPS executions and fold full windows into the site estimates:
+ * the abort rate of transactions and cycles per execution in each mode
+ * (exponential moving averages). Serial irrevocable executions are not
+ * aborts: libitm runs transactions so when they are cheaper (e.g. with a
+ * single thread), slow ones show up in cycles.
+ *
+ * A site leaves TM at once when the abort rate is above
+ * ABORT_RATE_HIGH. Otherwise after probeInterval windows in one mode it
+ * probes the other one for MIN_WINDOWS windows and keeps it only if it's
+ * SLOWER_RATIO times faster, so close estimates don't make it flap. Every
+ * lost probe doubles the interval, a won one resets it.
+ *
+ * Decisions are logged with their estimates and printed by report().
+ */
+class AdaptiveController {
+public:
+    enum Mode { MODE_TM, MODE_LOCK, MODES_COUNT };
+
+    // sites with larger ids share the last slot
+    static const size_t MAX_SITES = 64;
+    static const uint64_t WINDOW_OPS = 64;
+    static const size_t MIN_WINDOWS = 8;
+    static const size_t MIN_PROBE_INTERVAL = 16;
+    static const size_t MAX_PROBE_INTERVAL = 4096;
+
+    static constexpr double ABORT_RATE_HIGH = 0.3;
+    static constexpr double SLOWER_RATIO = 1.25;
+    static constexpr double SMOOTHING = 0.25;
+
+    static const char *modeName(size_t mode) {
+        static const char *NAMES[MODES_COUNT] = { "tm", "lock" };
+        return NAMES[mode];
+    }
+
+    /**
+     * Process-wide id of a site, call once per site
+     */
+    static size_t registerSite() {
+        static std::atomic<size_t> sitesCount(0);
+        const size_t siteId = sitesCount.fetch_add(1);
+        return (siteId < MAX_SITES) ? siteId : MAX_SITES - 1;
+    }
+
+    AdaptiveController() {
+        static std::atomic<uint64_t> generations(0);
+        m_generation = ++generations;
+        m_start = Timer::cycles();
+    }
+
+    // disable evil constructors
+    AdaptiveController(const AdaptiveController& controller);
+    AdaptiveController& operator=(const AdaptiveController& controller);
+
+    Mode mode(size_t siteId) const {
+        return (Mode) m_sites[siteId].mode.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Account one execution of the site by the calling thread
+     */
+    void record(size_t siteId, const char *file, int line, Mode mode,
+                uint64_t attempts, uint64_t failures, uint64_t cycles) {
+        Window& window = windowOf(siteId);
+        if (window.generation != m_generation || window.mode != mode) {
+            // new controller or the site switched meanwhile
+            window.reset(m_generation, mode);
+        }
+
+        window.ops++;
+        window.attempts += attempts;
+        window.failures += failures;
+        window.cycles += cycles;
+        if (window.ops < WINDOW_OPS) {
+            return;
+        }
+
+        Site& site = m_sites[siteId];
+        site.lock.lock();
+        if (site.file == NULL) {
+            site.file = file;
+            site.line = line;
+        }
+
+        if (site.mode.load(std::memory_order_relaxed) == mode) {
+            fold(siteId, window);
+        }
+
+        site.lock.unlock();
+        window.reset(m_generation, mode);
+    }
+
+    /**
+     * Decisions and final modes of sites, not thread-safe
+     */
+    void report(std::ostream& out) const {
+        const std::ios::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        for (const Decision& decision: m_decisions) {
+            const Site& site = m_sites[decision.siteId];
+            out << "Adaptive: " << siteName(site) << " at "
+                << std::fixed << std::setprecision(3) << decision.ms << " ms "
+                << modeName(decision.from) << " -> " << modeName(decision.to)
+                << " (" << decision.reason << "), abort rate "
+                << std::setprecision(2) << decision.abortRate
+                << ", cycles per section: tm " << std::setprecision(0) << decision.cycles[MODE_TM]
+                << ", lock " << decision.cycles[MODE_LOCK] << std::endl;
+        }
+
+        for (size_t siteId = 0; siteId < MAX_SITES; siteId++) {
+            const Site& site = m_sites[siteId];
+            if (site.file == NULL) {
+                continue;
+            }
+
+            out << "Adaptive: " << siteName(site) << " final mode "
+                << modeName(site.mode.load()) << ", switches " << site.switches
+                << ", windows tm " << site.totalWindows[MODE_TM]
+                << ", lock " << site.totalWindows[MODE_LOCK] << std::endl;
+        }
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+protected:
+    struct Window {
+        void reset(uint64_t generation, Mode mode) {
+            this->generation = generation;
+            this->mode = mode;
+            ops = 0;
+            attempts = 0;
+            failures = 0;
+            cycles = 0;
+        }
+
+        uint64_t generation;
+        Mode mode;
+        uint64_t ops;
+        uint64_t attempts;
+        uint64_t failures;
+        uint64_t cycles;
+    };
+
+    struct Site {
+        Site() {
+            mode.store(MODE_TM);
+            file = NULL;
+            line = 0;
+            abortRate = -1.0;
+            cycles[MODE_TM] = -1.0;
+            cycles[MODE_LOCK] = -1.0;
+            windows = 0;
+            isProbing = false;
+            totalWindows[MODE_TM] = 0;
+            totalWindows[MODE_LOCK] = 0;
+            probeInterval = MIN_PROBE_INTERVAL;
+            switches = 0;
+        }
+
+        char padding0[CACHE_LINE_SIZE];
+        std::atomic<int> mode;
+        TTASLock lock;
+        // fields below are guarded by the lock
+        const char *file;
+        int line;
+        // estimates, negative if unknown
+        double abortRate;
+        double cycles[MODES_COUNT];
+        // windows since the last switch
+        size_t windows;
+        // the mode is tried after the other one
+        bool isProbing;
+        size_t totalWindows[MODES_COUNT];
+        size_t probeInterval;
+        size_t switches;
+    };
+
+    struct Decision {
+        size_t siteId;
+        Mode from;
+        Mode to;
+        const char *reason;
+        double ms;
+        double abortRate;
+        double cycles[MODES_COUNT];
+    };
+
+    static void smooth(double *estimate, double sample) {
+        *estimate = (*estimate < 0.0) ? sample : *estimate + SMOOTHING * (sample - *estimate);
+    }
+
+    static std::string siteName(const Site& site) {
+        const char *slash = strrchr(site.file, '/');
+        std::ostringstream name;
+        name << ((slash != NULL) ? slash + 1 : site.file) << ":" << site.line;
+        return name.str();
+    }
+
+    Window& windowOf(size_t siteId) {
+        static thread_local Window windows[MAX_SITES];
+        return windows[siteId];
+    }
+
+    void fold(size_t siteId, const Window& window) {
+        Site& site = m_sites[siteId];
+        const Mode mode = window.mode;
+        const Mode other = (mode == MODE_TM) ? MODE_LOCK : MODE_TM;
+        smooth(&site.cycles[mode], (double) window.cycles / window.ops);
+        if (mode == MODE_TM) {
+            smooth(&site.abortRate, (double) window.failures / window.attempts);
+        }
+
+        site.windows++;
+        site.totalWindows[mode]++;
+        if (site.windows < MIN_WINDOWS) {
+            return;
+        }
+
+        if (mode == MODE_TM && site.abortRate > ABORT_RATE_HIGH) {
+            change(siteId, MODE_LOCK, "abort rate");
+        } else if (site.isProbing) {
+            if (SLOWER_RATIO * site.cycles[mode] < site.cycles[other]) {
+                site.isProbing = false;
+                site.probeInterval = MIN_PROBE_INTERVAL;
+            } else {
+                change(siteId, other, "probe lost");
+            }
+        } else if (site.windows >= site.probeInterval) {
+            change(siteId, other, "probe");
+            site.isProbing = true;
+        }
+    }
+
+    void change(size_t siteId, Mode to, const char *reason) {
+        Site& site = m_sites[siteId];
+        if (site.isProbing) {
+            // wait longer for the next probe
+            site.probeInterval = (2 * site.probeInterval < MAX_PROBE_INTERVAL) ?
+                    2 * site.probeInterval : MAX_PROBE_INTERVAL;
+        }
+
+        Decision decision;
+        decision.siteId = siteId;
+        decision.from = (Mode) site.mode.load(std::memory_order_relaxed);
+        decision.to = to;
+        decision.reason = reason;
+        decision.ms = Timer::instance().toNs(Timer::cycles() - m_start) / 1e6;
+        decision.abortRate = site.abortRate;
+        decision.cycles[MODE_TM] = site.cycles[MODE_TM];
+        decision.cycles[MODE_LOCK] = site.cycles[MODE_LOCK];
+        {
+            std::lock_guard<std::mutex> guard(m_decisionsMutex);
+            m_decisions.push_back(decision);
+        }
+
+        // estimates of the new mode are measured again
+        site.cycles[to] = -1.0;
+        if (to == MODE_TM) {
+            site.abortRate = -1.0;
+        }
+
+        site.windows = 0;
+        site.isProbing = false;
+        site.switches++;
+        site.mode.store(to, std::memory_order_relaxed);
+    }
+
+    uint64_t m_generation;
+    uint64_t m_start;
+    Site m_sites[MAX_SITES];
+    std::mutex m_decisionsMutex;
+    std::vector<Decision> m_decisions;
+};
+
+} // namespace Utils
+
+#endif // ADAPTIVECONTROLLER_H
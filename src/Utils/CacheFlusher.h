@@ -0,0 +1,143 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CACHEFLUSHER_H
+#define CACHEFLUSHER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+namespace Utils {
+
+/**
+ * Evicts data from CPU caches before cold-cache runs.
+ *
+ * Every thread of a run writes its part of a buffer larger than the last
+ * level cache, which replaces the contents of its private caches and
+ * (together with other threads) of the shared cache. Known memory ranges
+ * (e.g. the input) can be evicted exactly with clflush().
+ */
+class CacheFlusher {
+public:
+    static const size_t LINE_SIZE = 64;
+    static const size_t DEFAULT_LLC_SIZE = 32 * 1024 * 1024;
+
+    CacheFlusher() {
+        m_buffer = NULL;
+        m_size = 0;
+    }
+
+    ~CacheFlusher() {
+        free(m_buffer);
+    }
+
+    // disable evil constructors
+    CacheFlusher(const CacheFlusher& flusher);
+    CacheFlusher& operator=(const CacheFlusher& flusher);
+
+    /**
+     * Size of the largest cache reported by the system
+     */
+    static size_t lastLevelSize() {
+        const int levels[] = { _SC_LEVEL4_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE,
+                               _SC_LEVEL2_CACHE_SIZE };
+        for (int level: levels) {
+            const long size = sysconf(level);
+            if (size > 0) {
+                return size;
+            }
+        }
+
+        return DEFAULT_LLC_SIZE;
+    }
+
+    /**
+     * Allocate the buffer and fault its pages in, so that streaming
+     * doesn't measure page faults. Returns false if memory is exhausted.
+     */
+    bool resize(size_t size) {
+        if (size == m_size) {
+            return true;
+        }
+
+        free(m_buffer);
+        m_size = 0;
+        m_buffer = static_cast<uint8_t *>(malloc(size));
+        if (m_buffer == NULL) {
+            return false;
+        }
+
+        memset(m_buffer, 0, size);
+        m_size = size;
+        return true;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    /**
+     * Write every cache line of the part of the buffer
+     */
+    void stream(size_t part, size_t partsCount) {
+        const size_t lines = m_size / LINE_SIZE;
+        const size_t start = lines * part / partsCount;
+        const size_t end = lines * (part + 1) / partsCount;
+        for (size_t line = start; line < end; line++) {
+            volatile uint8_t *byte = m_buffer + line * LINE_SIZE;
+            *byte = *byte + 1;
+        }
+    }
+
+    /**
+     * Evict the range from caches of all cores
+     */
+    static void clflush(const void *data, size_t size) {
+        const uintptr_t start = reinterpret_cast<uintptr_t>(data) & ~(LINE_SIZE - 1);
+        const uintptr_t end = reinterpret_cast<uintptr_t>(data) + size;
+        for (uintptr_t line = start; line < end; line += LINE_SIZE) {
+            _mm_clflush(reinterpret_cast<const void *>(line));
+        }
+
+        _mm_mfence();
+    }
+
+protected:
+    uint8_t *m_buffer;
+    size_t m_size;
+};
+
+} // namespace Utils
+
+#endif // CACHEFLUSHER_H
@@ -0,0 +1,146 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef CONTAINERSTATS_H
+#define CONTAINERSTATS_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace Utils {
+
+/**
+ * Shape and memory footprint of a container returned by stats() of
+ * Vector, LinkedList, HashMap, TreeSet and TreeMap.
+ * Fields which don't apply to the container are zero.
+ */
+struct ContainerStats {
+    /** Buckets with longer chains are counted in the last histogram bin */
+    static const size_t MAX_CHAIN_BIN = 16;
+
+    ContainerStats(const std::string& kind = std::string()) {
+        this->kind = kind;
+        size = 0;
+        nodes = 0;
+        capacity = 0;
+        bytes = 0;
+        loadFactor = 0.0;
+        maxChain = 0;
+        maxDepth = 0;
+        avgDepth = 0.0;
+        blackHeight = 0;
+        isBalanced = true;
+    }
+
+    /**
+     * Bytes taken from glibc malloc for a request of the given size:
+     * the size header and alignment to 16 bytes, 32 bytes at least
+     */
+    static size_t allocated(size_t requested) {
+        const size_t chunk = (requested + sizeof(size_t) + 15) & ~(size_t) 15;
+        return chunk < 32 ? 32 : chunk;
+    }
+
+    /**
+     * Buckets by chain length for chains of length 0 .. MAX_CHAIN_BIN
+     */
+    void addChain(size_t length) {
+        if (length > maxChain) {
+            maxChain = length;
+        }
+
+        const size_t bin = length < MAX_CHAIN_BIN ? length : MAX_CHAIN_BIN;
+        if (chainLengths.size() <= bin) {
+            chainLengths.resize(bin + 1, 0);
+        }
+
+        chainLengths[bin]++;
+    }
+
+    void report(std::ostream& out) const {
+        out << "\tContainer: " << kind << ", " << size << " elements, "
+            << nodes << " nodes, " << bytes << " bytes";
+        if (size > 0) {
+            out << " (" << (double) bytes / size << " per element)";
+        }
+        out << std::endl;
+
+        if (capacity > 0) {
+            out << "\t\tcapacity " << capacity << ", load factor " << loadFactor << std::endl;
+        }
+
+        if (!chainLengths.empty()) {
+            out << "\t\tchains (length:buckets)";
+            for (size_t length = 0; length < chainLengths.size(); length++) {
+                if (chainLengths[length] > 0) {
+                    out << " " << length << (length == MAX_CHAIN_BIN ? "+" : "")
+                        << ":" << chainLengths[length];
+                }
+            }
+            out << ", max " << maxChain << std::endl;
+        }
+
+        if (kind == "red-black tree") {
+            out << "\t\tdepth max " << maxDepth << ", avg " << avgDepth
+                << ", black height " << blackHeight
+                << (isBalanced ? "" : ", NOT BALANCED") << std::endl;
+        }
+    }
+
+    std::string kind;
+    /** Elements stored */
+    size_t size;
+    /** Allocated nodes including head and sentinel nodes */
+    size_t nodes;
+    /** Slots of the vector or buckets of the hash table */
+    size_t capacity;
+    /** Bytes allocated including malloc overhead, see allocated() */
+    size_t bytes;
+    /** size / capacity */
+    double loadFactor;
+
+    std::vector<size_t> chainLengths;
+    size_t maxChain;
+
+    /** Depth of the root is 0 */
+    size_t maxDepth;
+    double avgDepth;
+    /** Black nodes on the path from the root to the leftmost leaf */
+    size_t blackHeight;
+    /** False if black heights differ or a red node has a red child */
+    bool isBalanced;
+};
+
+} // namespace Utils
+
+#endif // CONTAINERSTATS_H
@@ -0,0 +1,251 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef DELEGATIONSERVER_H
+#define DELEGATIONSERVER_H
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include <Utils/SpinLocks.h>
+
+namespace Utils {
+
+/**
+ * Delegation (remote core locking, Lozi et al., 2012).
+ *
+ * A dedicated server thread executes all operations on the shared data,
+ * so its working set stays in the cache of one core. Clients post a
+ * closure to their own cache-line sized and aligned mailbox and spin (yielding after
+ * a while) until the server has executed it. Closures live on the stack
+ * of the waiting client.
+ *
+ * Mailboxes are indexed by a dense client id (ThreadPool::threadId()),
+ * clients with the same id modulo MAX_CLIENTS take turns.
+ *
+ * The server polls only between start() and stop() (a timed run), the
+ * rest of the time it sleeps on a condition variable and wakes up for
+ * every posted operation, so it doesn't steal a CPU from setup and checks.
+ */
+class DelegationServer {
+public:
+    static const size_t MAX_CLIENTS = 256;
+
+    DelegationServer() {
+        m_stop.store(false);
+        m_isPolling.store(false);
+        m_clientsCount.store(0);
+
+        // one mailbox per cache line
+        void *memory = NULL;
+        if (posix_memalign(&memory, CACHE_LINE_SIZE, MAX_CLIENTS * sizeof(Mailbox)) != 0) {
+            throw std::bad_alloc();
+        }
+
+        m_mailboxes = static_cast<Mailbox*>(memory);
+        for (size_t clientId = 0; clientId < MAX_CLIENTS; clientId++) {
+            new (&m_mailboxes[clientId]) Mailbox();
+            m_mailboxes[clientId].claimed.store(false);
+            m_mailboxes[clientId].pending.store(false);
+        }
+
+        m_thread = std::thread(&DelegationServer::loop, this);
+    }
+
+    ~DelegationServer() {
+        {
+            std::lock_guard<std::mutex> guard(m_parkMutex);
+            m_stop.store(true);
+        }
+        m_parked.notify_one();
+        m_thread.join();
+        free(m_mailboxes);
+    }
+
+    // disable evil constructors
+    DelegationServer(const DelegationServer& server);
+    DelegationServer& operator=(const DelegationServer& server);
+
+    /**
+     * Run the server on the CPU only or on any CPU if cpu is negative.
+     * Returns false if the affinity can't be set.
+     */
+    bool pin(int cpu) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        if (cpu >= 0) {
+            if (cpu >= CPU_SETSIZE) {
+                return false;
+            }
+
+            CPU_SET(cpu, &cpus);
+        } else {
+            for (int i = 0; i < CPU_SETSIZE; i++) {
+                CPU_SET(i, &cpus);
+            }
+        }
+
+        return pthread_setaffinity_np(m_thread.native_handle(), sizeof(cpus), &cpus) == 0;
+    }
+
+    /**
+     * Poll mailboxes until stop()
+     */
+    void start() {
+        {
+            std::lock_guard<std::mutex> guard(m_parkMutex);
+            m_isPolling.store(true);
+        }
+        m_parked.notify_one();
+    }
+
+    /**
+     * Sleep when no operation is posted
+     */
+    void stop() {
+        m_isPolling.store(false);
+    }
+
+    template<class Function>
+    void execute(size_t clientId, Function& function) {
+        const size_t index = clientId % MAX_CLIENTS;
+        size_t clientsCount = m_clientsCount.load(std::memory_order_relaxed);
+        while (clientsCount <= index &&
+               !m_clientsCount.compare_exchange_weak(clientsCount, index + 1,
+                                                     std::memory_order_release)) {
+        }
+
+        Mailbox& mailbox = m_mailboxes[index];
+        SpinWait spin;
+        while (mailbox.claimed.load(std::memory_order_relaxed) ||
+               mailbox.claimed.exchange(true, std::memory_order_acquire)) {
+            spin.wait();
+        }
+
+        mailbox.context = &function;
+        mailbox.invoke = &invoke<Function>;
+        mailbox.pending.store(true, std::memory_order_release);
+        if (!m_isPolling.load(std::memory_order_seq_cst)) {
+            // the server checks mailboxes under the mutex before sleeping
+            std::lock_guard<std::mutex> guard(m_parkMutex);
+            m_parked.notify_one();
+        }
+
+        spin.reset();
+        while (mailbox.pending.load(std::memory_order_acquire)) {
+            spin.wait();
+        }
+
+        mailbox.claimed.store(false, std::memory_order_release);
+    }
+
+protected:
+    struct Mailbox {
+        void (*invoke)(void *context);
+        void *context;
+        // taken by a client for the whole operation
+        std::atomic<bool> claimed;
+        // set by the client, cleared by the server after execution
+        std::atomic<bool> pending;
+        char padding[CACHE_LINE_SIZE - 2 * sizeof(void*) - 2 * sizeof(std::atomic<bool>)];
+    };
+
+    static_assert(sizeof(Mailbox) == CACHE_LINE_SIZE, "Mailbox must fill one cache line");
+
+    template<class Function>
+    static void invoke(void *context) {
+        (*static_cast<Function *>(context))();
+    }
+
+    void loop() {
+        SpinWait idle;
+        while (!m_stop.load(std::memory_order_relaxed)) {
+            const size_t clientsCount = m_clientsCount.load(std::memory_order_acquire);
+            bool isIdle = true;
+            for (size_t index = 0; index < clientsCount; index++) {
+                Mailbox& mailbox = m_mailboxes[index];
+                if (mailbox.pending.load(std::memory_order_acquire)) {
+                    mailbox.invoke(mailbox.context);
+                    mailbox.pending.store(false, std::memory_order_release);
+                    isIdle = false;
+                }
+            }
+
+            if (!isIdle) {
+                idle.reset();
+            } else if (m_isPolling.load(std::memory_order_relaxed)) {
+                idle.wait();
+            } else {
+                park();
+                idle.reset();
+            }
+        }
+    }
+
+    void park() {
+        std::unique_lock<std::mutex> lock(m_parkMutex);
+        while (!m_isPolling.load() && !m_stop.load() && !hasPending()) {
+            m_parked.wait(lock);
+        }
+    }
+
+    bool hasPending() const {
+        const size_t clientsCount = m_clientsCount.load(std::memory_order_acquire);
+        for (size_t index = 0; index < clientsCount; index++) {
+            if (m_mailboxes[index].pending.load(std::memory_order_acquire)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // polled by the server on every pass
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_isPolling;
+    std::atomic<size_t> m_clientsCount;
+    char m_padding[CACHE_LINE_SIZE];
+    // aligned to CACHE_LINE_SIZE
+    Mailbox *m_mailboxes;
+    std::mutex m_parkMutex;
+    std::condition_variable m_parked;
+    std::thread m_thread;
+};
+
+} // namespace Utils
+
+#endif // DELEGATIONSERVER_H
@@ -0,0 +1,135 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <time.h>
+#include <string>
+#include <fstream>
+#include <thread>
+
+#include <Utils/Timer.h>
+
+// passed by Makefile
+#ifndef TESTER_CXXFLAGS
+#define TESTER_CXXFLAGS "unknown"
+#endif
+
+#ifndef TESTER_GIT_REVISION
+#define TESTER_GIT_REVISION "unknown"
+#endif
+
+namespace Utils {
+
+/**
+ * Description of the host and the build, recorded with results
+ */
+struct Environment {
+    std::string hostname;
+    std::string kernel;
+    std::string cpuModel;
+    unsigned cpusCount;
+    std::string governor;
+    std::string compiler;
+    std::string flags;
+    std::string revision;
+    std::string startTime;
+    // calibrated TSC frequency (GHz), see Timer
+    double tscFrequency;
+    bool tscInvariant;
+
+    static Environment collect() {
+        Environment env;
+
+        char hostname[256] = { 0 };
+        if (gethostname(hostname, sizeof(hostname) - 1) == 0) {
+            env.hostname = hostname;
+        }
+
+        struct utsname name;
+        if (uname(&name) == 0) {
+            env.kernel = std::string(name.sysname) + " " + name.release + " " + name.machine;
+        }
+
+        env.cpuModel = readCpuInfo("model name");
+        env.cpusCount = std::thread::hardware_concurrency();
+        env.governor = readFirstLine("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+        env.compiler = "GCC " __VERSION__;
+        env.flags = TESTER_CXXFLAGS;
+        env.revision = TESTER_GIT_REVISION;
+        env.tscFrequency = Timer::instance().cyclesPerNs();
+        env.tscInvariant = Timer::instance().isInvariant();
+
+        char timeBuffer[64] = { 0 };
+        const time_t now = time(NULL);
+        struct tm utc;
+        gmtime_r(&now, &utc);
+        strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        env.startTime = timeBuffer;
+
+        return env;
+    }
+
+protected:
+    static std::string readFirstLine(const char *path) {
+        std::ifstream file(path);
+        std::string line;
+        if (!std::getline(file, line)) {
+            return "unknown";
+        }
+
+        return line;
+    }
+
+    static std::string readCpuInfo(const std::string& field) {
+        std::ifstream file("/proc/cpuinfo");
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.compare(0, field.size(), field) != 0) {
+                continue;
+            }
+
+            const size_t colon = line.find(':');
+            if (colon != std::string::npos && colon + 2 <= line.size()) {
+                return line.substr(colon + 2);
+            }
+        }
+
+        return "unknown";
+    }
+};
+
+} // namespace Utils
+
+#endif // ENVIRONMENT_H
@@ -0,0 +1,103 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <stdint.h>
+
+#include <Utils/Random.h>
+
+namespace Utils {
+
+/**
+ * Order-independent fingerprint of a multiset of keys: count, sum and xor
+ * of mixed keys. Fingerprints of parts are merged into the fingerprint of
+ * their union.
+ */
+struct Fingerprint {
+    Fingerprint() {
+        count = 0;
+        sum = 0;
+        xorHash = 0;
+    }
+
+    void add(int64_t key) {
+        // mix(0) == 0, so shift keys first
+        const uint64_t hash = Random::mix(static_cast<uint64_t>(key) ^ 0x9E3779B97F4A7C15ULL);
+        count++;
+        sum += hash;
+        xorHash ^= hash;
+    }
+
+    void merge(const Fingerprint& other) {
+        count += other.count;
+        sum += other.sum;
+        xorHash ^= other.xorHash;
+    }
+
+    bool operator==(const Fingerprint& other) const {
+        return count == other.count && sum == other.sum && xorHash == other.xorHash;
+    }
+
+    bool operator!=(const Fingerprint& other) const {
+        return !operator==(other);
+    }
+
+    /**
+     * Adds keys visited by forEach() of sets and maps
+     */
+    struct Collector {
+        Collector(Fingerprint *fingerprint) {
+            m_fingerprint = fingerprint;
+        }
+
+        template<class KeyType>
+        void operator()(const KeyType& key) {
+            m_fingerprint->add(key);
+        }
+
+        template<class KeyType, class ValueType>
+        void operator()(const KeyType& key, const ValueType& value) {
+            m_fingerprint->add(key);
+        }
+
+        Fingerprint *m_fingerprint;
+    };
+
+    uint64_t count;
+    uint64_t sum;
+    uint64_t xorHash;
+};
+
+} // namespace Utils
+
+#endif // FINGERPRINT_H
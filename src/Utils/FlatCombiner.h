@@ -0,0 +1,155 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef FLATCOMBINER_H
+#define FLATCOMBINER_H
+
+#include <atomic>
+
+#include <Utils/SpinLocks.h>
+
+namespace Utils {
+
+/**
+ * Flat combining (Hendler, Incze, Shavit, Tzafrir, 2010).
+ *
+ * Every thread publishes its operation (a closure) in its own slot and
+ * waits until it is executed. A thread which takes the combiner lock
+ * executes all published operations in one pass, so the data structure
+ * and the lock stay in its cache instead of moving between cores on every
+ * operation. Closures live on the stack of the waiting thread.
+ *
+ * Threads are identified by a dense id (ThreadPool::threadId()), threads
+ * with the same id must not execute operations concurrently.
+ */
+class FlatCombiner {
+public:
+    static const size_t MAX_THREADS = 256;
+
+    FlatCombiner() {
+        m_locked.store(false);
+        m_slotsCount.store(0);
+        for (size_t threadId = 0; threadId < MAX_THREADS; threadId++) {
+            m_slots[threadId].pending.store(false);
+        }
+    }
+
+    // disable evil constructors
+    FlatCombiner(const FlatCombiner& combiner);
+    FlatCombiner& operator=(const FlatCombiner& combiner);
+
+    template<class Function>
+    void execute(size_t threadId, Function& function) {
+        if (threadId >= MAX_THREADS) {
+            // no slot, execute under the combiner lock
+            SpinWait spin;
+            while (!tryLock()) {
+                spin.wait();
+            }
+
+            function();
+            m_locked.store(false, std::memory_order_release);
+            return;
+        }
+
+        size_t slotsCount = m_slotsCount.load(std::memory_order_relaxed);
+        while (slotsCount <= threadId &&
+               !m_slotsCount.compare_exchange_weak(slotsCount, threadId + 1,
+                                                   std::memory_order_relaxed)) {
+        }
+
+        Slot& slot = m_slots[threadId];
+        slot.context = &function;
+        slot.invoke = &invoke<Function>;
+        slot.pending.store(true, std::memory_order_release);
+
+        SpinWait spin;
+        while (slot.pending.load(std::memory_order_acquire)) {
+            if (tryLock()) {
+                // our operation is published, so the pass executes it
+                combine();
+                m_locked.store(false, std::memory_order_release);
+            } else {
+                spin.wait();
+            }
+        }
+    }
+
+protected:
+    // scans of slots by one combiner, stops earlier if nothing is pending
+    static const size_t COMBINE_PASSES = 2;
+
+    struct Slot {
+        std::atomic<bool> pending;
+        void (*invoke)(void *context);
+        void *context;
+        char padding[CACHE_LINE_SIZE];
+    };
+
+    template<class Function>
+    static void invoke(void *context) {
+        (*static_cast<Function *>(context))();
+    }
+
+    bool tryLock() {
+        return !m_locked.load(std::memory_order_relaxed) &&
+                !m_locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void combine() {
+        const size_t slotsCount = m_slotsCount.load(std::memory_order_relaxed);
+        for (size_t pass = 0; pass < COMBINE_PASSES; pass++) {
+            size_t executed = 0;
+            for (size_t threadId = 0; threadId < slotsCount; threadId++) {
+                Slot& slot = m_slots[threadId];
+                if (slot.pending.load(std::memory_order_acquire)) {
+                    slot.invoke(slot.context);
+                    slot.pending.store(false, std::memory_order_release);
+                    executed++;
+                }
+            }
+
+            if (executed == 0) {
+                break;
+            }
+        }
+    }
+
+    char m_padBefore[CACHE_LINE_SIZE];
+    std::atomic<bool> m_locked;
+    char m_padAfter[CACHE_LINE_SIZE];
+    std::atomic<size_t> m_slotsCount;
+    Slot m_slots[MAX_THREADS];
+};
+
+} // namespace Utils
+
+#endif // FLATCOMBINER_H
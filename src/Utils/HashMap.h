@@ -35,20 +35,30 @@
 #include <limits.h>
 #include <algorithm>
 
+#include <Utils/ContainerStats.h>
+#include <Utils/Heatmap.h>
+#include <Utils/MemoryAccess.h>
+
 namespace Utils {
 
 /**
- * Map implementation based on hash table
+ * Map implementation based on hash table, shared fields are accessed
+ * through AccessParam (see MemoryAccess.h)
  */
-template<class KeyTypeParam, class ValueTypeParam>
+template<class KeyTypeParam, class ValueTypeParam, class AccessParam = DirectAccess>
 class HashMap {
 public:
     typedef KeyTypeParam KeyType;
     typedef ValueTypeParam ValueType;
+    typedef AccessParam Access;
 
     class Iterator;
 
-    HashMap(size_t bucketsCount = 1024) {
+    HashMap(size_t bucketsCount = 1024)
+#ifdef CONTAINER_HEATMAP
+        : m_heatmap("bucket", false)
+#endif
+    {
         const size_t MIN_BUCKETS = 1024;
         const size_t MAX_BUCKETS = (size_t) 1 << (sizeof(size_t) * CHAR_BIT - 1);
 
@@ -66,6 +76,8 @@ public:
         for(size_t b = 0; b < m_bucketsCount; b++) {
             m_buckets[b].next = NULL;
         }
+
+        HEATMAP(m_heatmap.resize(m_bucketsCount));
     }
 
     ~HashMap() {
@@ -87,6 +99,7 @@ public:
 
     Iterator find(const KeyType& key) const {
         size_t h = hash(key) & m_mask;
+        HEATMAP(m_heatmap.access(h));
         Node *cur = m_buckets[h].next;
 
         while (cur != NULL && cur->key <= key) {
@@ -140,6 +153,8 @@ public:
 
     Iterator insert(const KeyType& key, const ValueType& value) {
         size_t h = hash(key) & m_mask;
+        HEATMAP(m_heatmap.access(h));
+        HEATMAP(m_heatmap.write(h));
         Node *cur = &(m_buckets[h]);
 
         while (cur->next != NULL && cur->next->key <= key) {
@@ -157,6 +172,8 @@ public:
 
     Iterator insertMulti(const KeyType& key, const ValueType& value) {
         size_t h = hash(key) & m_mask;
+        HEATMAP(m_heatmap.access(h));
+        HEATMAP(m_heatmap.write(h));
         Node *cur = &(m_buckets[h]);
         while (cur->next != NULL && cur->next->key <= key) {
             cur = cur->next;
@@ -171,6 +188,8 @@ public:
         } else {
             Node *need = it.m_node;
             size_t h = hash(need->key) & m_mask;
+            HEATMAP(m_heatmap.access(h));
+            HEATMAP(m_heatmap.write(h));
             Node *cur = &(m_buckets[h]);
             while (cur->next != NULL && cur->next->key <= need->key && cur->next != need) {
                 cur = cur->next;
@@ -180,7 +199,7 @@ public:
                 return end();
             } else {
                 cur->next = cur->next->next;
-                delete need;
+                Access::destroy(need);
                 return ++Iterator(this, cur);
             }
         }
@@ -201,7 +220,7 @@ public:
             while (cur != NULL) {
                 Node *rem = cur;
                 cur = cur->next;
-                delete rem;
+                Access::destroy(rem);
             }
 
             m_buckets[h].next = NULL;
@@ -229,17 +248,64 @@ public:
         map.m_bucketsCount = oBucketsCount;
         map.m_mask = oldMask;
         map.m_buckets = oldBuckets;
+
+        HEATMAP(m_heatmap.resize(m_bucketsCount));
     }
 
     bool isEmpty() const {
         return  begin() == end();
     }
 
+#ifdef CONTAINER_HEATMAP
+    Heatmap& heatmap() {
+        return m_heatmap;
+    }
+#endif
+
+    /**
+     * Chain lengths and memory footprint, not thread-safe
+     */
+    ContainerStats stats() const {
+        ContainerStats result("hash map");
+        for(size_t h = 0; h < m_bucketsCount; h++) {
+            size_t length = 0;
+            for(Node *cur = m_buckets[h].next; cur != NULL; cur = cur->next) {
+                length++;
+            }
+
+            result.addChain(length);
+            result.size += length;
+        }
+
+        // bucket heads are stored in one array
+        result.nodes = result.size;
+        result.capacity = m_bucketsCount;
+        result.loadFactor = (double) result.size / m_bucketsCount;
+        result.bytes = ContainerStats::allocated(m_bucketsCount * sizeof(Node)) +
+                result.nodes * ContainerStats::allocated(sizeof(Node));
+        return result;
+    }
+
+    /**
+     * Call function(key, value) for nodes of the part of buckets,
+     * parts are disjoint and together cover all nodes
+     */
+    template<class Function>
+    void forEach(size_t part, size_t partsCount, Function function) const {
+        const size_t start = m_bucketsCount * part / partsCount;
+        const size_t end = m_bucketsCount * (part + 1) / partsCount;
+        for(size_t h = start; h < end; h++) {
+            for(Node *cur = m_buckets[h].next; cur != NULL; cur = cur->next) {
+                function(cur->key, cur->value);
+            }
+        }
+    }
+
 protected:
     struct Node {
-        KeyType key;
-        ValueType value;
-        Node *next;
+        typename Access::template Field<KeyType> key;
+        typename Access::template Field<ValueType> value;
+        typename Access::template Field<Node*> next;
     };
 
 public:
@@ -278,15 +344,15 @@ public:
             return !operator==(it);
         }
 
-        const KeyType& key() const {
+        KeyType key() const {
             return m_node->key;
         }
 
-        const KeyType& operator*() const {
+        KeyType operator*() const {
             return key();
         }
 
-        const ValueType& value() const {
+        ValueType value() const {
             return m_node->value;
         }
 
@@ -331,7 +397,7 @@ protected:
     }
 
     Iterator insert(const KeyType& key, const ValueType& value, Node *prev) {
-        Node *insertNode = new Node();
+        Node *insertNode = Access::template create<Node>();
         insertNode->key = key;
         insertNode->value = value;
         insertNode->next = prev->next;
@@ -373,6 +439,9 @@ protected:
     size_t m_bucketsCount;
     size_t m_mask;
     Node *m_buckets;
+#ifdef CONTAINER_HEATMAP
+    Heatmap m_heatmap;
+#endif
 
     std::hash<KeyType> hasher;
 };
@@ -0,0 +1,241 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+#include <atomic>
+#include <new>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <algorithm>
+
+#include <Utils/SpinLocks.h>
+
+namespace Utils {
+
+/**
+ * Access, write and conflict counters per slot of a container (hash bucket,
+ * tree depth), compiled into containers with -DCONTAINER_HEATMAP
+ * (make HEATMAP=1).
+ *
+ * A write is counted as a conflict if the previous write to the same slot
+ * was made by another thread less than CONFLICT_WINDOW cycles ago. This
+ * approximates conflicting concurrent writes without knowing what the
+ * synchronization backend does. Counters are updated from transactions,
+ * so they are transaction_pure and don't take part in conflict detection.
+ * It means that under TM and STM aborted attempts are counted too, and
+ * under flat combining and delegation all writes come from the combiner
+ * or server thread, so few conflicts are seen there.
+ */
+class Heatmap {
+public:
+    static const uint64_t CONFLICT_WINDOW = 10000;
+
+    /**
+     * Dense heatmaps have few slots and all of them are reported,
+     * the last slot may have a special name
+     */
+    Heatmap(const std::string& slotName, bool isDense,
+            const std::string& lastSlotName = std::string()) {
+        m_slotName = slotName;
+        m_isDense = isDense;
+        m_lastSlotName = lastSlotName;
+        m_slots = NULL;
+        m_slotsCount = 0;
+    }
+
+    ~Heatmap() {
+        free(m_slots);
+    }
+
+    // disable evil constructors
+    Heatmap(const Heatmap& heatmap);
+    Heatmap& operator=(const Heatmap& heatmap);
+
+    /**
+     * Set slots count, counters are reset
+     */
+    void resize(size_t slotsCount) {
+        free(m_slots);
+        m_slots = NULL;
+        m_slotsCount = 0;
+
+        // one slot per cache line, so counters of neighbours don't collide
+        void *memory = NULL;
+        if (posix_memalign(&memory, CACHE_LINE_SIZE, slotsCount * sizeof(Slot)) != 0) {
+            throw std::bad_alloc();
+        }
+
+        m_slots = static_cast<Slot*>(memory);
+        for(size_t slot = 0; slot < slotsCount; slot++) {
+            new (&m_slots[slot]) Slot();
+        }
+
+        m_slotsCount = slotsCount;
+    }
+
+    void reset() {
+        for(size_t slot = 0; slot < m_slotsCount; slot++) {
+            m_slots[slot].accesses.store(0, std::memory_order_relaxed);
+            m_slots[slot].writes.store(0, std::memory_order_relaxed);
+            m_slots[slot].conflicts.store(0, std::memory_order_relaxed);
+            m_slots[slot].lastWriter.store(0, std::memory_order_relaxed);
+            m_slots[slot].lastWriteTime.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    __attribute__((transaction_pure))
+    void access(size_t slot) const {
+        if (slot < m_slotsCount) {
+            m_slots[slot].accesses.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    __attribute__((transaction_pure))
+    void write(size_t slot) const {
+        if (slot >= m_slotsCount) {
+            return;
+        }
+
+        Slot& s = m_slots[slot];
+        const uint64_t now = __rdtsc();
+        const uint64_t writer = threadTag();
+
+        s.writes.fetch_add(1, std::memory_order_relaxed);
+        const uint64_t lastWriter = s.lastWriter.exchange(writer, std::memory_order_relaxed);
+        const uint64_t lastTime = s.lastWriteTime.exchange(now, std::memory_order_relaxed);
+        if (lastWriter != 0 && lastWriter != writer && now - lastTime < CONFLICT_WINDOW) {
+            s.conflicts.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Print totals and hot slots: all non-empty slots for dense heatmaps
+     * (tree depths), top N slots by conflicts and accesses otherwise
+     */
+    void report(std::ostream& out, size_t topCount = 10) const {
+        uint64_t accesses = 0, writes = 0, conflicts = 0;
+        std::vector<size_t> used;
+        for(size_t slot = 0; slot < m_slotsCount; slot++) {
+            accesses += m_slots[slot].accesses.load(std::memory_order_relaxed);
+            writes += m_slots[slot].writes.load(std::memory_order_relaxed);
+            conflicts += m_slots[slot].conflicts.load(std::memory_order_relaxed);
+            if (m_slots[slot].accesses.load(std::memory_order_relaxed) > 0 ||
+                    m_slots[slot].writes.load(std::memory_order_relaxed) > 0) {
+                used.push_back(slot);
+            }
+        }
+
+        out << "\tHeatmap by " << m_slotName << ": " << accesses << " accesses, "
+            << writes << " writes, " << conflicts << " conflicts, "
+            << used.size() << " of " << m_slotsCount << " " << m_slotName << "s used" << std::endl;
+        out << "\t(tm and stm count aborted attempts too, fc and delegation writes "
+            << "come from one thread)" << std::endl;
+
+        if (!m_isDense) {
+            std::sort(used.begin(), used.end(), [this](size_t a, size_t b) {
+                return key(a) > key(b);
+            });
+            used.resize(std::min(used.size(), topCount));
+        }
+
+        for(size_t i = 0; i < used.size(); i++) {
+            const Slot& s = m_slots[used[i]];
+            if (!m_lastSlotName.empty() && used[i] + 1 == m_slotsCount) {
+                out << "\t\t" << m_lastSlotName << ": ";
+            } else {
+                out << "\t\t" << m_slotName << " " << used[i] << ": ";
+            }
+            out << s.accesses.load(std::memory_order_relaxed) << " accesses, "
+                << s.writes.load(std::memory_order_relaxed) << " writes, "
+                << s.conflicts.load(std::memory_order_relaxed) << " conflicts" << std::endl;
+        }
+    }
+
+protected:
+    struct Slot {
+        Slot() {
+            accesses.store(0);
+            writes.store(0);
+            conflicts.store(0);
+            lastWriter.store(0);
+            lastWriteTime.store(0);
+        }
+
+        std::atomic<uint64_t> accesses;
+        std::atomic<uint64_t> writes;
+        std::atomic<uint64_t> conflicts;
+        std::atomic<uint64_t> lastWriter;
+        std::atomic<uint64_t> lastWriteTime;
+        char padding[CACHE_LINE_SIZE - 5 * sizeof(std::atomic<uint64_t>)];
+    };
+
+    static_assert(sizeof(Slot) == CACHE_LINE_SIZE, "Slot must fill one cache line");
+
+    /**
+     * Non-zero id of the calling thread
+     */
+    static uint64_t threadTag() {
+        static std::atomic<uint64_t> lastTag(0);
+        static thread_local uint64_t tag = 0;
+        if (tag == 0) {
+            tag = ++lastTag;
+        }
+
+        return tag;
+    }
+
+    std::pair<uint64_t, uint64_t> key(size_t slot) const {
+        return std::make_pair(m_slots[slot].conflicts.load(std::memory_order_relaxed),
+                              m_slots[slot].accesses.load(std::memory_order_relaxed));
+    }
+
+    std::string m_slotName;
+    bool m_isDense;
+    std::string m_lastSlotName;
+    Slot *m_slots;
+    size_t m_slotsCount;
+};
+
+} // namespace Utils
+
+#ifdef CONTAINER_HEATMAP
+#define HEATMAP(statement) statement
+#else
+#define HEATMAP(statement)
+#endif
+
+#endif // HEATMAP_H
@@ -0,0 +1,173 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+namespace Utils {
+
+/**
+ * Log-linear (HDR-style) histogram of unsigned integer values.
+ *
+ * Every power of two range is split into SUB_BUCKETS linear sub-buckets,
+ * so the relative error of a reported value is below 1 / SUB_BUCKETS.
+ * record() is a few arithmetic instructions and one increment.
+ */
+class Histogram {
+public:
+    enum {
+        SUB_BUCKET_BITS = 5,
+        SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+        BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS
+    };
+
+    Histogram() {
+        reset();
+    }
+
+    void reset() {
+        memset(m_counts, 0, sizeof(m_counts));
+        m_count = 0;
+        m_sum = 0;
+        m_min = UINT64_MAX;
+        m_max = 0;
+    }
+
+    void record(uint64_t value) {
+        m_counts[index(value)]++;
+        m_count++;
+        m_sum += value;
+
+        if (value < m_min) {
+            m_min = value;
+        }
+
+        if (value > m_max) {
+            m_max = value;
+        }
+    }
+
+    void merge(const Histogram& histogram) {
+        for(size_t i = 0; i < BUCKETS; i++) {
+            m_counts[i] += histogram.m_counts[i];
+        }
+
+        m_count += histogram.m_count;
+        m_sum += histogram.m_sum;
+
+        if (histogram.m_min < m_min) {
+            m_min = histogram.m_min;
+        }
+
+        if (histogram.m_max > m_max) {
+            m_max = histogram.m_max;
+        }
+    }
+
+    /**
+     * Value below which the given percent of recorded values fall
+     */
+    uint64_t percentile(double percent) const {
+        if (m_count == 0) {
+            return 0;
+        }
+
+        uint64_t target = static_cast<uint64_t>(ceil(percent / 100.0 * m_count));
+        if (target == 0) {
+            target = 1;
+        }
+
+        uint64_t cumulative = 0;
+        for(size_t i = 0; i < BUCKETS; i++) {
+            cumulative += m_counts[i];
+            if (cumulative >= target) {
+                const uint64_t result = value(i);
+                return (result > m_max) ? m_max : result;
+            }
+        }
+
+        return m_max;
+    }
+
+    uint64_t count() const {
+        return m_count;
+    }
+
+    uint64_t min() const {
+        return (m_count > 0) ? m_min : 0;
+    }
+
+    uint64_t max() const {
+        return m_max;
+    }
+
+    double mean() const {
+        return (m_count > 0) ? (double) m_sum / m_count : 0.0;
+    }
+
+protected:
+    static size_t index(uint64_t value) {
+        if (value < 2 * SUB_BUCKETS) {
+            return value;
+        }
+
+        const size_t exponent = 63 - __builtin_clzll(value);
+        const size_t shift = exponent - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + (value >> shift) - SUB_BUCKETS;
+    }
+
+    /**
+     * Middle of the range of values mapped to the bucket
+     */
+    static uint64_t value(size_t index) {
+        if (index < 2 * SUB_BUCKETS) {
+            return index;
+        }
+
+        const size_t shift = index / SUB_BUCKETS - 1;
+        const uint64_t lower = (uint64_t) (index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+        return lower + ((uint64_t) 1 << shift) / 2;
+    }
+
+    uint64_t m_counts[BUCKETS];
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+} // namespace Utils
+
+#endif // HISTOGRAM_H
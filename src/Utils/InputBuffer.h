@@ -0,0 +1,230 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef INPUTBUFFER_H
+#define INPUTBUFFER_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <Utils/Fingerprint.h>
+
+namespace Utils {
+
+/**
+ * Read-only array of input keys, either generated in memory or mapped
+ * from a binary input file.
+ *
+ * File format: Header padded to HEADER_SIZE bytes, then count keys in
+ * native byte order.
+ */
+class InputBuffer {
+public:
+    typedef int KeyType;
+
+    static const size_t HEADER_SIZE = 4096;
+    static const uint32_t VERSION = 1;
+
+    struct Header {
+        Header() {
+            memcpy(magic, InputBuffer::magic(), sizeof(magic));
+            version = VERSION;
+            keySize = sizeof(KeyType);
+            seed = 0;
+            count = 0;
+            memset(distribution, 0, sizeof(distribution));
+        }
+
+        bool isValid() const {
+            return memcmp(magic, InputBuffer::magic(), sizeof(magic)) == 0 &&
+                    version == VERSION && keySize == sizeof(KeyType);
+        }
+
+        char magic[8];
+        uint32_t version;
+        uint32_t keySize;
+        uint64_t seed;
+        uint64_t count;
+        // KeyDistribution::toString()
+        char distribution[64];
+        Fingerprint fingerprint;
+    };
+
+    InputBuffer() {
+        m_data = NULL;
+        m_size = 0;
+        m_mapping = NULL;
+        m_mappingSize = 0;
+    }
+
+    ~InputBuffer() {
+        unmap();
+    }
+
+    // disable evil constructors
+    InputBuffer(const InputBuffer& buffer);
+    InputBuffer& operator=(const InputBuffer& buffer);
+
+    /**
+     * Allocate in-memory storage for size keys, drops the mapping
+     */
+    void resize(size_t size) {
+        unmap();
+        m_owned.resize(size);
+        m_data = m_owned.data();
+        m_size = size;
+    }
+
+    /**
+     * Map the input file read-only, pages are populated in advance so
+     * page faults don't happen during runs.
+     * Returns false if the file doesn't exist or is invalid.
+     */
+    bool load(const std::string& path, Header *header) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < HEADER_SIZE) {
+            close(fd);
+            return false;
+        }
+
+        void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+
+        memcpy(header, mapping, sizeof(*header));
+        if (!header->isValid() ||
+                HEADER_SIZE + header->count * sizeof(KeyType) != static_cast<size_t>(st.st_size)) {
+            munmap(mapping, st.st_size);
+            return false;
+        }
+
+        unmap();
+        std::vector<KeyType>().swap(m_owned);
+        m_mapping = mapping;
+        m_mappingSize = st.st_size;
+        m_data = reinterpret_cast<const KeyType *>(static_cast<char *>(mapping) + HEADER_SIZE);
+        m_size = header->count;
+        return true;
+    }
+
+    /**
+     * Write the header and keys to the file; the file is replaced atomically,
+     * so concurrent testers never see a partial file
+     */
+    bool save(const std::string& path, const Header& header) const {
+        const std::string tmpPath = path + ".tmp";
+        FILE *file = fopen(tmpPath.c_str(), "wb");
+        if (file == NULL) {
+            return false;
+        }
+
+        std::vector<char> headerData(HEADER_SIZE, 0);
+        memcpy(headerData.data(), &header, sizeof(header));
+
+        bool isOk = fwrite(headerData.data(), 1, HEADER_SIZE, file) == HEADER_SIZE &&
+                fwrite(m_data, sizeof(KeyType), m_size, file) == m_size;
+        isOk = (fclose(file) == 0) && isOk;
+
+        if (!isOk || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            unlink(tmpPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    bool isMapped() const {
+        return m_mapping != NULL;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    const KeyType *begin() const {
+        return m_data;
+    }
+
+    const KeyType *end() const {
+        return m_data + m_size;
+    }
+
+    const KeyType& operator[](size_t i) const {
+        return m_data[i];
+    }
+
+    /**
+     * Writable keys, only for in-memory storage
+     */
+    KeyType *data() {
+        return m_owned.data();
+    }
+
+protected:
+    static const char *magic() {
+        // 8 bytes with the terminating zero
+        return "TMKEYS\0";
+    }
+
+    void unmap() {
+        if (m_mapping != NULL) {
+            munmap(m_mapping, m_mappingSize);
+            m_mapping = NULL;
+            m_mappingSize = 0;
+            m_data = NULL;
+            m_size = 0;
+        }
+    }
+
+    std::vector<KeyType> m_owned;
+    const KeyType *m_data;
+    size_t m_size;
+    void *m_mapping;
+    size_t m_mappingSize;
+};
+
+} // namespace Utils
+
+#endif // INPUTBUFFER_H
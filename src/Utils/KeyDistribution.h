@@ -0,0 +1,291 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef KEYDISTRIBUTION_H
+#define KEYDISTRIBUTION_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include "Random.h"
+
+namespace Utils {
+
+/**
+ * Zipf distribution over [1, n] with the given exponent.
+ *
+ * Rejection-inversion sampling (W. Hormann, G. Derflinger): all constants
+ * are precomputed, a draw takes O(1) time and rarely more than one
+ * iteration.
+ */
+class ZipfGenerator {
+public:
+    ZipfGenerator(uint64_t n = 1, double exponent = 1.0) {
+        init(n, exponent);
+    }
+
+    void init(uint64_t n, double exponent) {
+        m_n = (n > 0) ? n : 1;
+        m_exponent = exponent;
+        m_hIntegralX1 = hIntegral(1.5) - 1.0;
+        m_hIntegralN = hIntegral(m_n + 0.5);
+        m_s = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+    }
+
+    uint64_t operator()(Random& random) const {
+        while (true) {
+            const double u = m_hIntegralN +
+                    random.uniformReal() * (m_hIntegralX1 - m_hIntegralN);
+            const double x = hIntegralInverse(u);
+
+            uint64_t k = static_cast<uint64_t>(x + 0.5);
+            if (k < 1) {
+                k = 1;
+            } else if (k > m_n) {
+                k = m_n;
+            }
+
+            if (k - x <= m_s || u >= hIntegral(k + 0.5) - h(k)) {
+                return k;
+            }
+        }
+    }
+
+protected:
+    double h(double x) const {
+        return exp(-m_exponent * log(x));
+    }
+
+    double hIntegral(double x) const {
+        const double logX = log(x);
+        return helper2((1.0 - m_exponent) * logX) * logX;
+    }
+
+    double hIntegralInverse(double x) const {
+        double t = x * (1.0 - m_exponent);
+        if (t < -1.0) {
+            t = -1.0;
+        }
+
+        return exp(helper1(t) * x);
+    }
+
+    // log1p(x) / x with a correct limit at zero
+    static double helper1(double x) {
+        if (fabs(x) > 1e-8) {
+            return log1p(x) / x;
+        } else {
+            return 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+        }
+    }
+
+    // expm1(x) / x with a correct limit at zero
+    static double helper2(double x) {
+        if (fabs(x) > 1e-8) {
+            return expm1(x) / x;
+        } else {
+            return 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+        }
+    }
+
+    uint64_t m_n;
+    double m_exponent;
+    double m_hIntegralX1;
+    double m_hIntegralN;
+    double m_s;
+};
+
+/**
+ * Distribution of keys in [0, range) used to generate test input.
+ *
+ * Specification syntax:
+ *   uniform
+ *   zipf[:EXPONENT]           - key 0 is the most popular one
+ *   hotspot[:OPS%:KEYS%]      - OPS% of draws hit the first KEYS% of keys
+ *   sequential                - key = index
+ *   reverse                   - key = range - 1 - index
+ */
+class KeyDistribution {
+public:
+    enum Type {
+        UNIFORM,
+        ZIPF,
+        HOTSPOT,
+        SEQUENTIAL,
+        REVERSE
+    };
+
+    KeyDistribution() {
+        m_type = UNIFORM;
+        m_range = 1;
+        m_exponent = 0.99;
+        m_hotOps = 0.9;
+        m_hotKeys = 0.1;
+        m_hotRange = 1;
+    }
+
+    /**
+     * Returns false if the specification is invalid
+     */
+    bool parse(const std::string& spec) {
+        std::istringstream stream(spec);
+        std::string name;
+        std::getline(stream, name, ':');
+
+        std::string param;
+        std::vector<double> params;
+        while (std::getline(stream, param, ':')) {
+            char *end = NULL;
+            params.push_back(strtod(param.c_str(), &end));
+            if (param.empty() || *end != '\0') {
+                return false;
+            }
+        }
+
+        if (name == "uniform" && params.empty()) {
+            m_type = UNIFORM;
+        } else if (name == "zipf" && params.size() <= 1) {
+            m_type = ZIPF;
+            if (params.size() > 0) {
+                m_exponent = params[0];
+            }
+
+            if (m_exponent <= 0.0) {
+                return false;
+            }
+        } else if (name == "hotspot" && (params.size() == 0 || params.size() == 2)) {
+            m_type = HOTSPOT;
+            if (params.size() == 2) {
+                m_hotOps = params[0] / 100.0;
+                m_hotKeys = params[1] / 100.0;
+            }
+
+            if (m_hotOps < 0.0 || m_hotOps > 1.0 || m_hotKeys <= 0.0 || m_hotKeys > 1.0) {
+                return false;
+            }
+        } else if (name == "sequential" && params.empty()) {
+            m_type = SEQUENTIAL;
+        } else if (name == "reverse" && params.empty()) {
+            m_type = REVERSE;
+        } else {
+            return false;
+        }
+
+        setRange(m_range);
+        return true;
+    }
+
+    /**
+     * Set number of distinct keys and precompute distribution constants
+     */
+    void setRange(uint64_t range) {
+        m_range = (range > 0) ? range : 1;
+
+        if (m_type == ZIPF) {
+            m_zipf.init(m_range, m_exponent);
+        } else if (m_type == HOTSPOT) {
+            m_hotRange = static_cast<uint64_t>(m_range * m_hotKeys);
+            if (m_hotRange < 1) {
+                m_hotRange = 1;
+            }
+        }
+    }
+
+    /**
+     * Key for the given position of the input
+     */
+    uint64_t operator()(Random& random, uint64_t index) const {
+        switch (m_type) {
+        case ZIPF:
+            return m_zipf(random) - 1;
+        case HOTSPOT:
+            if (m_hotRange >= m_range || random.uniformReal() < m_hotOps) {
+                return random.uniform(m_hotRange);
+            } else {
+                return m_hotRange + random.uniform(m_range - m_hotRange);
+            }
+        case SEQUENTIAL:
+            return index % m_range;
+        case REVERSE:
+            return m_range - 1 - index % m_range;
+        case UNIFORM:
+        default:
+            return random.uniform(m_range);
+        }
+    }
+
+    Type type() const {
+        return m_type;
+    }
+
+    std::string toString() const {
+        std::ostringstream result;
+        switch (m_type) {
+        case ZIPF:
+            result << "zipf:" << m_exponent;
+            break;
+        case HOTSPOT:
+            result << "hotspot:" << m_hotOps * 100.0 << ":" << m_hotKeys * 100.0;
+            break;
+        case SEQUENTIAL:
+            result << "sequential";
+            break;
+        case REVERSE:
+            result << "reverse";
+            break;
+        case UNIFORM:
+        default:
+            result << "uniform";
+            break;
+        }
+
+        return result.str();
+    }
+
+protected:
+    Type m_type;
+    uint64_t m_range;
+
+    double m_exponent;
+    ZipfGenerator m_zipf;
+
+    double m_hotOps;
+    double m_hotKeys;
+    uint64_t m_hotRange;
+};
+
+} // namespace Utils
+
+#endif // KEYDISTRIBUTION_H
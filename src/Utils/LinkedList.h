@@ -32,6 +32,8 @@
 #ifndef LINKEDLIST_H
 #define LINKEDLIST_H
 
+#include <Utils/ContainerStats.h>
+
 namespace Utils {
 
 template<class ValueTypeParam>
@@ -111,6 +113,33 @@ public:
         return m_size == 0;
     }
 
+    /**
+     * Memory footprint, not thread-safe
+     */
+    ContainerStats stats() const {
+        ContainerStats result("linked list");
+        result.size = m_size;
+        // and the head
+        result.nodes = m_size + 1;
+        result.bytes = result.nodes * ContainerStats::allocated(sizeof(Node));
+        return result;
+    }
+
+    /**
+     * Call function(value) for elements of the part of the list.
+     * The list can't be split without traversal, so part 0 has all elements.
+     */
+    template<class Function>
+    void forEach(size_t part, size_t partsCount, Function function) const {
+        if (part != 0) {
+            return;
+        }
+
+        for(Node *cur = m_head->next; cur != NULL; cur = cur->next) {
+            function(cur->value);
+        }
+    }
+
 protected:
     class Node;
 public:
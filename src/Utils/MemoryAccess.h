@@ -0,0 +1,68 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef MEMORYACCESS_H
+#define MEMORYACCESS_H
+
+namespace Utils {
+
+/**
+ * How containers access their shared fields (see HashMap and RBTree).
+ *
+ * Fields are declared as Access::Field<T>, nodes are allocated with
+ * Access::create() and freed with Access::destroy(). Access::load()
+ * gives the value of a field where an implicit conversion doesn't work
+ * (member calls, returning values). DirectAccess is plain memory,
+ * STM::Access (see STM.h) instruments every access for the in-tree STM.
+ */
+struct DirectAccess {
+    template<class T>
+    using Field = T;
+
+    template<class T>
+    static const T& load(const T& field) {
+        return field;
+    }
+
+    template<class T>
+    static T *create() {
+        return new T();
+    }
+
+    template<class T>
+    static void destroy(T *object) {
+        delete object;
+    }
+};
+
+} // namespace Utils
+
+#endif // MEMORYACCESS_H
@@ -0,0 +1,258 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
+
+namespace Utils {
+
+/**
+ * Hardware and software performance counters of the calling thread
+ * (see perf_event_open(2)).
+ *
+ * Every event is opened separately, so events which are not supported
+ * by the CPU or not permitted (perf_event_paranoid, containers) are just
+ * marked as unavailable.
+ */
+class PerfCounters {
+public:
+    enum Event {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,
+        LLC_MISSES,
+        BRANCH_MISSES,
+        CONTEXT_SWITCHES,
+        EVENTS_COUNT
+    };
+
+    static const char *eventName(size_t event) {
+        static const char *NAMES[EVENTS_COUNT] = {
+            "cycles", "instructions", "l1d_misses", "llc_misses",
+            "branch_misses", "context_switches"
+        };
+
+        return NAMES[event];
+    }
+
+    /**
+     * Counted values, scaled if the kernel multiplexed counters
+     */
+    struct Values {
+        Values() {
+            for(size_t event = 0; event < EVENTS_COUNT; event++) {
+                value[event] = 0;
+                available[event] = false;
+            }
+        }
+
+        void merge(const Values& other) {
+            for(size_t event = 0; event < EVENTS_COUNT; event++) {
+                value[event] += other.value[event];
+                available[event] = available[event] || other.available[event];
+            }
+        }
+
+        bool isAvailable() const {
+            for(size_t event = 0; event < EVENTS_COUNT; event++) {
+                if (available[event]) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        uint64_t value[EVENTS_COUNT];
+        bool available[EVENTS_COUNT];
+    };
+
+    PerfCounters() {
+        m_error = 0;
+        for(size_t event = 0; event < EVENTS_COUNT; event++) {
+            m_fds[event] = -1;
+        }
+    }
+
+    ~PerfCounters() {
+        close();
+    }
+
+    // disable evil constructors
+    PerfCounters(const PerfCounters& counters);
+    PerfCounters& operator=(const PerfCounters& counters);
+
+    /**
+     * Open disabled counters for the calling thread.
+     * Returns false if no counter is available.
+     */
+    bool open() {
+        close();
+
+        bool isOpened = false;
+        for(size_t event = 0; event < EVENTS_COUNT; event++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.disabled = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            setup(event, &attr);
+
+            m_fds[event] = perfEventOpen(&attr);
+            if (m_fds[event] < 0 && !attr.exclude_kernel) {
+                // unprivileged users may count only user space
+                attr.exclude_kernel = 1;
+                m_fds[event] = perfEventOpen(&attr);
+            }
+
+            if (m_fds[event] < 0) {
+                m_error = errno;
+            } else {
+                isOpened = true;
+            }
+        }
+
+        return isOpened;
+    }
+
+    void close() {
+        for(size_t event = 0; event < EVENTS_COUNT; event++) {
+            if (m_fds[event] >= 0) {
+                ::close(m_fds[event]);
+                m_fds[event] = -1;
+            }
+        }
+    }
+
+    void start() {
+        for(size_t event = 0; event < EVENTS_COUNT; event++) {
+            if (m_fds[event] >= 0) {
+                ioctl(m_fds[event], PERF_EVENT_IOC_RESET, 0);
+                ioctl(m_fds[event], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    /**
+     * Disable counters and add their values to *values
+     */
+    void stop(Values *values) {
+        for(size_t event = 0; event < EVENTS_COUNT; event++) {
+            if (m_fds[event] < 0) {
+                continue;
+            }
+
+            ioctl(m_fds[event], PERF_EVENT_IOC_DISABLE, 0);
+
+            // value, time enabled, time running
+            uint64_t data[3];
+            if (::read(m_fds[event], data, sizeof(data)) != sizeof(data)) {
+                continue;
+            }
+
+            if (data[2] > 0 && data[2] < data[1]) {
+                data[0] = static_cast<uint64_t>(
+                            static_cast<double>(data[0]) * data[1] / data[2]);
+            }
+
+            values->value[event] += data[0];
+            values->available[event] = true;
+        }
+    }
+
+    /**
+     * Reason why some counter is unavailable
+     */
+    std::string error() const {
+        return (m_error != 0) ? strerror(m_error) : "";
+    }
+
+protected:
+    static int perfEventOpen(struct perf_event_attr *attr) {
+        // this thread, any CPU
+        return syscall(__NR_perf_event_open, attr, 0, -1, -1, 0);
+    }
+
+    static void setup(size_t event, struct perf_event_attr *attr) {
+        switch (event) {
+        case CYCLES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            attr->exclude_kernel = 1;
+            break;
+        case INSTRUCTIONS:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            attr->exclude_kernel = 1;
+            break;
+        case L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = PERF_COUNT_HW_CACHE_L1D |
+                           (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr->exclude_kernel = 1;
+            break;
+        case LLC_MISSES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CACHE_MISSES;
+            attr->exclude_kernel = 1;
+            break;
+        case BRANCH_MISSES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            attr->exclude_kernel = 1;
+            break;
+        case CONTEXT_SWITCHES:
+            // switches are counted in the kernel
+            attr->type = PERF_TYPE_SOFTWARE;
+            attr->config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            break;
+        }
+    }
+
+    int m_fds[EVENTS_COUNT];
+    int m_error;
+};
+
+} // namespace Utils
+
+#endif // PERFCOUNTERS_H
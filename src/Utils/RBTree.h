@@ -32,29 +32,40 @@
 #ifndef RBTREE_H
 #define RBTREE_H
 
+#include <Utils/ContainerStats.h>
+#include <Utils/Heatmap.h>
+#include <Utils/MemoryAccess.h>
+
 namespace Utils {
 namespace Private {
 
 /**
- * Red-Black tree (used by TreeSet and TreeMap)
+ * Red-Black tree (used by TreeSet and TreeMap), shared fields are
+ * accessed through AccessParam (see MemoryAccess.h)
  */
-template<class KeyTypeParam>
+template<class KeyTypeParam, class AccessParam = DirectAccess>
 class RBTree {
 public:
     typedef KeyTypeParam KeyType;
+    typedef AccessParam Access;
 
     enum Color { COLOR_BLACK, COLOR_RED };
 
     struct Node {
-        Node *parent;
-        Node *left;
-        Node *right;
+        typename Access::template Field<Node*> parent;
+        typename Access::template Field<Node*> left;
+        typename Access::template Field<Node*> right;
 
-        KeyType key;
-        Color color;
+        typename Access::template Field<KeyType> key;
+        typename Access::template Field<Color> color;
     };
 
-    RBTree() {
+    RBTree()
+#ifdef CONTAINER_HEATMAP
+        : m_heatmap("depth", true, "sentinel")
+#endif
+    {
+        HEATMAP(m_heatmap.resize(HEATMAP_DEPTHS + 1));
         m_size = 0;
         m_root = NULL;
 
@@ -95,13 +106,15 @@ public:
     Node *find(const KeyType& key) const
     {
         Node *current = m_root;
+        HEATMAP(size_t depth = 0);
         while(current != NULL && current != m_nullNode) {
+            HEATMAP(m_heatmap.access(depthSlot(depth++)));
             if(key < current->key) {
                 current = current->left;
-            } else if (current-> key < key){
+            } else if (Access::load(current->key) < key){
                 current = current->right;
             } else {
-                while(current->left != m_nullNode && current->left->key == key) {
+                while(current->left != m_nullNode && Access::load(current->left->key) == key) {
                     current = current->left;
                 }
                 return current;
@@ -188,11 +201,13 @@ public:
     {
         Node *current = m_root;
         Node *prev = NULL;
+        HEATMAP(size_t depth = 0);
 
         while(current != NULL && current != m_nullNode) {
             prev = current;
+            HEATMAP(m_heatmap.access(depthSlot(depth++)));
 
-            if(current->key == key) {
+            if(Access::load(current->key) == key) {
                 // update key
                 current->key = key;
                 return current;
@@ -212,9 +227,11 @@ public:
     {
         Node *current = m_root;
         Node *prev = NULL;
+        HEATMAP(size_t depth = 0);
 
         while(current != NULL && current != m_nullNode) {
             prev = current;
+            HEATMAP(m_heatmap.access(depthSlot(depth++)));
 
             if(key < current->key) {
                 current = current->left;
@@ -232,6 +249,8 @@ public:
             return NULL;
         }
 
+        HEATMAP(m_heatmap.write(depthOf(removeNode)));
+
         Node *successorNode = successor(removeNode);
 
         if(removeNode->left != m_nullNode && removeNode->right != m_nullNode) {
@@ -312,6 +331,7 @@ public:
         }
 
         child->parent = removeNode->parent;
+        HEATMAP(if (child == m_nullNode) m_heatmap.write(HEATMAP_DEPTHS));
 
         if(removeNode->parent != NULL) {
             if(removeNode == removeNode->parent->left) {
@@ -331,7 +351,7 @@ public:
             removeFix(child);
         }
 
-        delete removeNode;
+        Access::destroy(removeNode);
 
         // HACK: don't use m_size for TM performance reasons
         // m_size--;
@@ -357,6 +377,12 @@ public:
         int count;
     };
 
+#ifdef CONTAINER_HEATMAP
+    Heatmap& heatmap() {
+        return m_heatmap;
+    }
+#endif
+
     void clear() {
         size_t mysize = size();
         Node** stack = new Node*[mysize];
@@ -369,28 +395,132 @@ public:
         }
 
         for(size_t i = 0; i < mysize; i++) {
-            delete stack[i];
+            Access::destroy(stack[i]);
         }
 
         m_root = NULL;
     }
 
+    /**
+     * Depths, black height and memory footprint, not thread-safe
+     */
+    ContainerStats stats() const {
+        ContainerStats result("red-black tree");
+        for(Node *cur = m_root; cur != NULL && cur != m_nullNode; cur = cur->left) {
+            if (cur->color == COLOR_BLACK) {
+                result.blackHeight++;
+            }
+        }
+
+        size_t depthSum = 0;
+        stats(m_root, 0, 0, &depthSum, &result);
+        if (m_root != NULL && m_root->color != COLOR_BLACK) {
+            result.isBalanced = false;
+        }
+
+        if (result.size > 0) {
+            result.avgDepth = (double) depthSum / result.size;
+        }
+
+        // and the sentinel
+        result.nodes = result.size + 1;
+        result.bytes = result.nodes * ContainerStats::allocated(sizeof(Node));
+        return result;
+    }
+
+    /**
+     * Call function(key) for nodes of the part of the tree.
+     * Nodes above PARTITION_DEPTH belong to part 0, subtrees rooted at
+     * PARTITION_DEPTH are distributed between parts round-robin.
+     */
+    template<class Function>
+    void forEach(size_t part, size_t partsCount, Function function) const {
+        forEach(m_root, 0, 0, part, partsCount, function);
+    }
+
 protected:
     enum RotateDirection { ROTATE_LEFT,  ROTATE_RIGHT };
 
+#ifdef CONTAINER_HEATMAP
+    // deeper levels are counted as the last one
+    static const size_t HEATMAP_DEPTHS = 64;
+
+    static size_t depthSlot(size_t depth) {
+        return (depth < HEATMAP_DEPTHS) ? depth : HEATMAP_DEPTHS - 1;
+    }
+
+    size_t depthOf(Node *node) const {
+        size_t depth = 0;
+        while (node->parent != NULL && depth < HEATMAP_DEPTHS - 1) {
+            node = node->parent;
+            depth++;
+        }
+
+        return depth;
+    }
+#endif
+
+    static const size_t PARTITION_DEPTH = 8;
+
+    template<class Function>
+    void forEach(Node *node, size_t depth, size_t index,
+                 size_t part, size_t partsCount, Function& function) const {
+        if (node == NULL || node == m_nullNode) {
+            return;
+        }
+
+        if (depth == PARTITION_DEPTH && index % partsCount != part) {
+            return;
+        }
+
+        if (depth >= PARTITION_DEPTH || part == 0) {
+            function(node->key);
+        }
+
+        forEach(node->left, depth + 1, 2 * index, part, partsCount, function);
+        forEach(node->right, depth + 1, 2 * index + 1, part, partsCount, function);
+    }
+
+    void stats(Node *node, size_t depth, size_t blacks,
+               size_t *depthSum, ContainerStats *result) const {
+        if (node == NULL || node == m_nullNode) {
+            if (blacks != result->blackHeight) {
+                result->isBalanced = false;
+            }
+
+            return;
+        }
+
+        result->size++;
+        *depthSum += depth;
+        if (depth > result->maxDepth) {
+            result->maxDepth = depth;
+        }
+
+        if (node->color == COLOR_BLACK) {
+            blacks++;
+        } else if (node->left->color == COLOR_RED || node->right->color == COLOR_RED) {
+            result->isBalanced = false;
+        }
+
+        stats(node->left, depth + 1, blacks, depthSum, result);
+        stats(node->right, depth + 1, blacks, depthSum, result);
+    }
+
     Node *insert(const KeyType& key, Node *prev)
     {
-        Node *node = new Node;
+        Node *node = Access::template create<Node>();
         node->key = key;
         node->left = m_nullNode;
         node->right = m_nullNode;
         node->parent = prev;
         node->color = COLOR_RED;
+        HEATMAP(m_heatmap.write(depthOf(node)));
 
         if(prev == NULL) {
             m_root = node;
         } else {
-            if( node->key < prev->key ) {
+            if( key < Access::load(prev->key) ) {
                 prev->left = node;
             } else {
                 prev->right = node;
@@ -532,6 +662,7 @@ protected:
 
     void rotate(Node *current, RotateDirection direction)
     {
+        HEATMAP(m_heatmap.write(depthOf(current)));
         Node *child = NULL;
         if(direction == ROTATE_LEFT) {
             child = current->right;
@@ -566,8 +697,11 @@ protected:
     }
 
     int m_size;
-    Node *m_root;
+    typename Access::template Field<Node*> m_root;
     Node *m_nullNode;
+#ifdef CONTAINER_HEATMAP
+    Heatmap m_heatmap;
+#endif
 };
 
 } // namespace Private
@@ -0,0 +1,116 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+namespace Utils {
+
+/**
+ * Fast seedable pseudo-random generator (xoshiro256**).
+ *
+ * The state is initialized by SplitMix64 from (seed, stream) pair, so
+ * generators with the same seed and different streams are independent
+ * and can be used by different threads without any synchronization.
+ */
+class Random {
+public:
+    Random(uint64_t seed = 0, uint64_t stream = 0) {
+        reseed(seed, stream);
+    }
+
+    void reseed(uint64_t seed, uint64_t stream = 0) {
+        uint64_t splitMix = mix(seed) ^ mix(stream + 0x9E3779B97F4A7C15ULL);
+        for(int i = 0; i < 4; i++) {
+            m_state[i] = splitMix64(splitMix);
+        }
+    }
+
+    uint64_t next() {
+        const uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+        const uint64_t t = m_state[1] << 17;
+
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+
+        return result;
+    }
+
+    uint64_t operator()() {
+        return next();
+    }
+
+    /**
+     * Uniformly distributed integer in [0, range)
+     */
+    uint64_t uniform(uint64_t range) {
+        __extension__ typedef unsigned __int128 uint128_t;
+        return (uint64_t) (((uint128_t) next() * range) >> 64);
+    }
+
+    /**
+     * Uniformly distributed real in [0, 1)
+     */
+    double uniformReal() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /**
+     * SplitMix64 finalizer, a good 64-bit hash function
+     */
+    static uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+protected:
+    static uint64_t splitMix64(uint64_t& state) {
+        state += 0x9E3779B97F4A7C15ULL;
+        return mix(state);
+    }
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t m_state[4];
+};
+
+} // namespace Utils
+
+#endif // RANDOM_H
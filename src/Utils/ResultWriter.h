@@ -0,0 +1,256 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef RESULTWRITER_H
+#define RESULTWRITER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+
+namespace Utils {
+
+/**
+ * Flat ordered set of named values (one result).
+ * Numbers are kept formatted, NaN and infinity as NULL_NUMBER.
+ */
+class Record {
+public:
+    struct Field {
+        std::string name;
+        std::string value;
+        bool isString;
+        bool isArray;
+    };
+
+    void add(const std::string& name, const std::string& value) {
+        Field field = { name, value, true, false };
+        m_fields.push_back(field);
+    }
+
+    void add(const std::string& name, const char *value) {
+        add(name, std::string(value));
+    }
+
+    void add(const std::string& name, double value) {
+        Field field = { name, number(value), false, false };
+        m_fields.push_back(field);
+    }
+
+    void add(const std::string& name, uint64_t value) {
+        add(name, static_cast<double>(value));
+    }
+
+    template<class T>
+    void add(const std::string& name, const std::vector<T>& values) {
+        std::string value;
+        for(size_t i = 0; i < values.size(); i++) {
+            if (i > 0) {
+                value += ",";
+            }
+
+            value += number(static_cast<double>(values[i]));
+        }
+
+        Field field = { name, value, false, true };
+        m_fields.push_back(field);
+    }
+
+    const std::vector<Field>& fields() const {
+        return m_fields;
+    }
+
+    // JSON has no literals for NaN and infinity
+    static constexpr const char *NULL_NUMBER = "null";
+
+protected:
+    static std::string number(double value) {
+        if (!std::isfinite(value)) {
+            return NULL_NUMBER;
+        }
+
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.12g", value);
+        return buffer;
+    }
+
+    std::vector<Field> m_fields;
+};
+
+/**
+ * Writes records as JSON objects, one per line
+ */
+class JsonWriter {
+public:
+    bool open(const std::string& path) {
+        m_file.open(path.c_str(), std::ios::out | std::ios::app);
+        return m_file.is_open();
+    }
+
+    void write(const Record& record) {
+        if (!m_file.is_open()) {
+            return;
+        }
+
+        const std::vector<Record::Field>& fields = record.fields();
+        m_file << "{";
+        for(size_t i = 0; i < fields.size(); i++) {
+            if (i > 0) {
+                m_file << ", ";
+            }
+
+            m_file << "\"" << escape(fields[i].name) << "\": ";
+            if (fields[i].isString) {
+                m_file << "\"" << escape(fields[i].value) << "\"";
+            } else if (fields[i].isArray) {
+                m_file << "[" << fields[i].value << "]";
+            } else {
+                m_file << fields[i].value;
+            }
+        }
+
+        m_file << "}" << std::endl;
+    }
+
+protected:
+    static std::string escape(const std::string& str) {
+        std::string result;
+        for(size_t i = 0; i < str.size(); i++) {
+            const unsigned char c = str[i];
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (c < 0x20) {
+                char buffer[8];
+                snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                result += buffer;
+            } else {
+                result += c;
+            }
+        }
+
+        return result;
+    }
+
+    std::ofstream m_file;
+};
+
+/**
+ * Writes records as CSV rows, the header is taken from the first record.
+ * Arrays are stored as ';'-separated lists.
+ */
+class CsvWriter {
+public:
+    CsvWriter() {
+        m_hasHeader = false;
+    }
+
+    bool open(const std::string& path) {
+        std::ifstream existing(path.c_str());
+        m_hasHeader = (existing.peek() != std::ifstream::traits_type::eof());
+
+        m_file.open(path.c_str(), std::ios::out | std::ios::app);
+        return m_file.is_open();
+    }
+
+    void write(const Record& record) {
+        if (!m_file.is_open()) {
+            return;
+        }
+
+        const std::vector<Record::Field>& fields = record.fields();
+        if (!m_hasHeader) {
+            for(size_t i = 0; i < fields.size(); i++) {
+                m_file << (i > 0 ? "," : "") << quote(fields[i].name);
+            }
+
+            m_file << std::endl;
+            m_hasHeader = true;
+        }
+
+        for(size_t i = 0; i < fields.size(); i++) {
+            m_file << (i > 0 ? "," : "") << cell(fields[i]);
+        }
+
+        m_file << std::endl;
+    }
+
+protected:
+    /**
+     * Missing numbers are empty cells (or empty items of arrays)
+     */
+    static std::string cell(const Record::Field& field) {
+        if (field.isString) {
+            return quote(field.value);
+        }
+
+        std::string result;
+        size_t start = 0;
+        while (true) {
+            const size_t end = field.isArray ? field.value.find(',', start) : std::string::npos;
+            const std::string item = field.value.substr(start, end == std::string::npos ?
+                                                        std::string::npos : end - start);
+            if (item != Record::NULL_NUMBER) {
+                result += item;
+            }
+
+            if (end == std::string::npos) {
+                return result;
+            }
+
+            result += ';';
+            start = end + 1;
+        }
+    }
+
+    static std::string quote(const std::string& str) {
+        std::string result = "\"";
+        for(size_t i = 0; i < str.size(); i++) {
+            if (str[i] == '"') {
+                result += '"';
+            }
+
+            result += str[i];
+        }
+
+        return result + "\"";
+    }
+
+    std::ofstream m_file;
+    bool m_hasHeader;
+};
+
+} // namespace Utils
+
+#endif // RESULTWRITER_H
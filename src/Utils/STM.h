@@ -0,0 +1,762 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef STM_H
+#define STM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <Utils/SpinLocks.h>
+#include <Utils/Random.h>
+
+namespace Utils {
+
+/**
+ * Word-based software transactional memory in the style of TL2
+ * (Dice, Shalev, Shavit, 2006), independent of the ITM runtime.
+ *
+ * Memory is covered by a table of ownership records (orecs), every orec
+ * guards all words of a stripe hashed to it. An unlocked orec holds the
+ * version (the global clock value of the last commit which wrote it)
+ * shifted left by one, a locked orec holds the owner descriptor with the
+ * lowest bit set.
+ *
+ * Reads are validated against the clock sampled at txBegin() and logged,
+ * writes are buffered in a redo log (lazy versioning). txCommit() locks
+ * the orecs of the written words, takes a new clock value, validates the
+ * read set, writes the log back and releases the orecs with the new
+ * version. A conflict rolls the transaction back and throws Abort.
+ *
+ * Outside of a transaction txRead() and txWrite() are plain accesses,
+ * so instrumented containers can be set up and checked single-threaded.
+ *
+ * Memory released by a committed transaction may still be read by
+ * transactions which started earlier and are doomed to abort, so it isn't
+ * freed at once (epoch-based reclamation). Every transaction publishes the
+ * global epoch at txBegin(), a commit which releases memory advances the
+ * epoch and puts the memory to the limbo list of its thread tagged with
+ * the new epoch. The memory is freed when no thread is in a transaction
+ * begun before the tag. It costs a full fence at txBegin() and a scan of
+ * all threads once per LIMBO_BATCH released blocks.
+ */
+namespace STM {
+
+/**
+ * Global clock: gv1 increments it on every commit, gv4 lets committers
+ * which fail to increment it share the value written by the winner
+ */
+enum ClockMode { CLOCK_GV1, CLOCK_GV4 };
+
+/**
+ * Reaction to a locked orec: suicide aborts at once, wait spins for a
+ * while hoping that the owner finishes, backoff aborts at once and delays
+ * the retry for a random time which grows with consecutive aborts
+ */
+enum ContentionManager { CM_SUICIDE, CM_WAIT, CM_BACKOFF };
+
+enum AbortReason {
+    // orec of a read word is locked
+    ABORT_LOCKED_READ,
+    // orec of a written word is locked at commit
+    ABORT_LOCKED_WRITE,
+    // read word is newer than the transaction
+    ABORT_VALIDATE_READ,
+    // read set is changed before commit
+    ABORT_VALIDATE_COMMIT
+};
+
+struct Config {
+    Config() {
+        orecsCount = 1 << 20;
+        stripeSize = 8;
+        clock = CLOCK_GV4;
+        contention = CM_BACKOFF;
+    }
+
+    // power of two
+    size_t orecsCount;
+    // bytes guarded by one orec, a power of two not less than a word
+    size_t stripeSize;
+    ClockMode clock;
+    ContentionManager contention;
+};
+
+/**
+ * Thrown when a transaction conflicts, it's already rolled back
+ */
+struct Abort {
+    AbortReason reason;
+};
+
+/**
+ * Orecs and the global clock shared by all transactions
+ */
+class Runtime {
+public:
+    static Runtime& instance() {
+        static Runtime runtime;
+        return runtime;
+    }
+
+    // disable evil constructors
+    Runtime(const Runtime& runtime);
+    Runtime& operator=(const Runtime& runtime);
+
+    ~Runtime() {
+        delete[] m_orecs;
+    }
+
+    /**
+     * Not thread-safe, no transaction may run meanwhile
+     */
+    void configure(const Config& config) {
+        if (config.orecsCount != m_config.orecsCount) {
+            delete[] m_orecs;
+            m_orecs = new std::atomic<uint64_t>[config.orecsCount];
+        }
+
+        m_config = config;
+        m_stripeShift = 0;
+        while (((size_t) 1 << m_stripeShift) < config.stripeSize) {
+            m_stripeShift++;
+        }
+
+        // versions in orecs may not be newer than the clock
+        m_clock.store(0);
+        for (size_t index = 0; index < m_config.orecsCount; index++) {
+            m_orecs[index].store(0);
+        }
+    }
+
+    const Config& config() const {
+        return m_config;
+    }
+
+    std::atomic<uint64_t>& orec(const void *address) {
+        return m_orecs[((uintptr_t) address >> m_stripeShift) & (m_config.orecsCount - 1)];
+    }
+
+    uint64_t now() const {
+        return m_clock.load(std::memory_order_acquire);
+    }
+
+    uint64_t epoch() const {
+        return m_epoch.load(std::memory_order_seq_cst);
+    }
+
+    /**
+     * Returns the new epoch, transactions which publish it or a later one
+     * can't see memory released before the call
+     */
+    uint64_t advanceEpoch() {
+        return m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    }
+
+    /**
+     * Epoch of a thread is IDLE_EPOCH outside of transactions
+     */
+    void attach(const std::atomic<uint64_t> *epoch) {
+        std::lock_guard<std::mutex> guard(m_threadsMutex);
+        m_threadEpochs.push_back(epoch);
+    }
+
+    void detach(const std::atomic<uint64_t> *epoch) {
+        std::lock_guard<std::mutex> guard(m_threadsMutex);
+        m_threadEpochs.erase(std::find(m_threadEpochs.begin(), m_threadEpochs.end(), epoch));
+    }
+
+    /**
+     * The oldest epoch published by a running transaction
+     */
+    uint64_t oldestEpoch() {
+        std::lock_guard<std::mutex> guard(m_threadsMutex);
+        uint64_t oldest = IDLE_EPOCH;
+        for (const std::atomic<uint64_t> *epoch: m_threadEpochs) {
+            oldest = std::min(oldest, epoch->load(std::memory_order_seq_cst));
+        }
+
+        return oldest;
+    }
+
+    static const uint64_t IDLE_EPOCH = ~(uint64_t) 0;
+
+    /**
+     * New clock value for a commit, *exclusive is false if it's shared
+     * with another commit (gv4)
+     */
+    uint64_t tick(bool *exclusive) {
+        if (m_config.clock == CLOCK_GV1) {
+            *exclusive = true;
+            return m_clock.fetch_add(1, std::memory_order_acq_rel) + 1;
+        }
+
+        uint64_t observed = m_clock.load(std::memory_order_acquire);
+        *exclusive = m_clock.compare_exchange_strong(observed, observed + 1,
+                                                    std::memory_order_acq_rel);
+        // the failed CAS loads the value of the winner
+        return *exclusive ? observed + 1 : observed;
+    }
+
+protected:
+    Runtime() {
+        m_orecs = NULL;
+        m_config.orecsCount = 0;
+        m_epoch.store(0);
+        configure(Config());
+    }
+
+    char m_padding0[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> m_clock;
+    char m_padding1[CACHE_LINE_SIZE];
+    std::atomic<uint64_t> m_epoch;
+    char m_padding2[CACHE_LINE_SIZE];
+    std::mutex m_threadsMutex;
+    std::vector<const std::atomic<uint64_t>*> m_threadEpochs;
+    std::atomic<uint64_t> *m_orecs;
+    size_t m_stripeShift;
+    Config m_config;
+};
+
+typedef uint64_t __attribute__((__may_alias__)) Word;
+
+/**
+ * Transaction descriptor, one per thread
+ */
+class Transaction {
+public:
+    static const uintptr_t WORD_SIZE = sizeof(Word);
+
+    static Transaction& current() {
+        static thread_local Transaction transaction;
+        return transaction;
+    }
+
+    // disable evil constructors
+    Transaction(const Transaction& transaction);
+    Transaction& operator=(const Transaction& transaction);
+
+    bool isActive() const {
+        return m_isActive;
+    }
+
+    ~Transaction() {
+        Runtime& runtime = Runtime::instance();
+        runtime.detach(&m_epoch);
+
+        // other threads may still read the limbo
+        SpinWait spin;
+        while (!m_limbo.empty()) {
+            reclaim();
+            spin.wait();
+        }
+    }
+
+    void begin() {
+        Runtime& runtime = Runtime::instance();
+        m_isActive = true;
+        // published before any read, a concurrent reclaim() either sees it
+        // or has advanced the epoch before all memory it frees was unlinked
+        m_epoch.store(runtime.epoch(), std::memory_order_seq_cst);
+        m_readVersion = runtime.now();
+    }
+
+    template<class T>
+    T read(const T *address) {
+        const uintptr_t start = (uintptr_t) address;
+        const uintptr_t end = start + sizeof(T);
+
+        T result;
+        unsigned char *bytes = static_cast<unsigned char*>(static_cast<void*>(&result));
+        for (uintptr_t word = start & ~(WORD_SIZE - 1); word < end; word += WORD_SIZE) {
+            const uint64_t value = readWord((const Word*) word);
+            const uintptr_t from = std::max(word, start);
+            const uintptr_t to = std::min(word + WORD_SIZE, end);
+            memcpy(bytes + (from - start), (const unsigned char*) &value + (from - word),
+                   to - from);
+        }
+
+        return result;
+    }
+
+    template<class T>
+    void write(T *address, const T& value) {
+        const uintptr_t start = (uintptr_t) address;
+        const uintptr_t end = start + sizeof(T);
+
+        const unsigned char *bytes = static_cast<const unsigned char*>(
+                static_cast<const void*>(&value));
+        for (uintptr_t word = start & ~(WORD_SIZE - 1); word < end; word += WORD_SIZE) {
+            const uintptr_t from = std::max(word, start);
+            const uintptr_t to = std::min(word + WORD_SIZE, end);
+
+            uint64_t data = 0;
+            uint64_t mask = 0;
+            memcpy((unsigned char*) &data + (from - word), bytes + (from - start), to - from);
+            memset((unsigned char*) &mask + (from - word), 0xff, to - from);
+            writeWord((Word*) word, data, mask);
+        }
+    }
+
+    /**
+     * Memory allocated by an aborted transaction is freed
+     */
+    void *allocate(size_t size) {
+        void *memory = malloc(size);
+        if (m_isActive) {
+            m_allocated.push_back(memory);
+        }
+
+        return memory;
+    }
+
+    /**
+     * Memory is freed after commit when no transaction may read it. All its
+     * words are locked at commit, so transactions which still read it abort.
+     */
+    void release(void *memory, size_t size) {
+        if (!m_isActive) {
+            free(memory);
+            return;
+        }
+
+        const uintptr_t start = (uintptr_t) memory;
+        for (uintptr_t word = start & ~(WORD_SIZE - 1); word < start + size; word += WORD_SIZE) {
+            writeWord((Word*) word, 0, 0);
+        }
+
+        m_released.push_back(memory);
+    }
+
+    void commit() {
+        if (m_writes.empty()) {
+            // read-only, all reads were consistent at the read version
+            finish();
+            return;
+        }
+
+        Runtime& runtime = Runtime::instance();
+        const bool wait = runtime.config().contention == CM_WAIT;
+        for (const WriteEntry& entry: m_writes) {
+            std::atomic<uint64_t>& orec = runtime.orec(entry.address);
+            uint64_t value = orec.load(std::memory_order_relaxed);
+            SpinWait spin;
+            size_t spins = 0;
+            while (value != lockValue()) {
+                if (value & LOCKED) {
+                    if (!wait || spins++ >= WAIT_SPINS) {
+                        abort(ABORT_LOCKED_WRITE);
+                    }
+
+                    spin.wait();
+                    value = orec.load(std::memory_order_relaxed);
+                } else if (orec.compare_exchange_weak(value, lockValue(),
+                                                      std::memory_order_acquire,
+                                                      std::memory_order_relaxed)) {
+                    m_locked.push_back(LockedOrec(&orec, value));
+                    break;
+                }
+            }
+        }
+
+        bool exclusive = false;
+        const uint64_t writeVersion = runtime.tick(&exclusive);
+        if (!exclusive || writeVersion != m_readVersion + 1) {
+            // somebody committed since begin()
+            validate();
+        }
+
+        for (const WriteEntry& entry: m_writes) {
+            if (entry.mask == FULL_MASK) {
+                __atomic_store_n(entry.address, entry.value, __ATOMIC_RELAXED);
+            } else if (entry.mask != 0) {
+                const uint64_t old = __atomic_load_n(entry.address, __ATOMIC_RELAXED);
+                __atomic_store_n(entry.address, (old & ~entry.mask) | entry.value,
+                                 __ATOMIC_RELAXED);
+            }
+        }
+
+        for (const LockedOrec& locked: m_locked) {
+            locked.orec->store(writeVersion << 1, std::memory_order_release);
+        }
+
+        if (!m_released.empty()) {
+            const uint64_t epoch = runtime.advanceEpoch();
+            for (void *memory: m_released) {
+                m_limbo.push_back(Retired(epoch, memory));
+            }
+        }
+
+        finish();
+
+        if (m_limbo.size() >= LIMBO_BATCH) {
+            reclaim();
+        }
+    }
+
+protected:
+    static const uint64_t LOCKED = 1;
+    static const uint64_t FULL_MASK = ~(uint64_t) 0;
+    static const size_t WAIT_SPINS = 1024;
+    static const size_t MAX_BACKOFF_SHIFT = 10;
+    static const size_t BACKOFF_UNIT = 16;
+    static const size_t LIMBO_BATCH = 64;
+
+    struct WriteEntry {
+        WriteEntry(Word *address, uint64_t value, uint64_t mask) {
+            this->address = address;
+            this->value = value;
+            this->mask = mask;
+        }
+
+        Word *address;
+        // only bytes of the mask are written
+        uint64_t value;
+        uint64_t mask;
+    };
+
+    struct LockedOrec {
+        LockedOrec(std::atomic<uint64_t> *orec, uint64_t previous) {
+            this->orec = orec;
+            this->previous = previous;
+        }
+
+        std::atomic<uint64_t> *orec;
+        // unlocked value before commit
+        uint64_t previous;
+    };
+
+    struct Retired {
+        Retired(uint64_t epoch, void *memory) {
+            this->epoch = epoch;
+            this->memory = memory;
+        }
+
+        // epoch advanced by the commit which released the memory
+        uint64_t epoch;
+        void *memory;
+    };
+
+    Transaction(): m_random((uintptr_t) this) {
+        m_isActive = false;
+        m_readVersion = 0;
+        m_writeFilter = 0;
+        m_consecutiveAborts = 0;
+        m_epoch.store(Runtime::IDLE_EPOCH);
+        Runtime::instance().attach(&m_epoch);
+    }
+
+    uint64_t lockValue() const {
+        return (uintptr_t) this | LOCKED;
+    }
+
+    static uint64_t filterBit(const Word *address) {
+        return (uint64_t) 1 << (((uintptr_t) address / WORD_SIZE) % 64);
+    }
+
+    WriteEntry *findWrite(const Word *address) {
+        if ((m_writeFilter & filterBit(address)) == 0) {
+            return NULL;
+        }
+
+        for (size_t index = m_writes.size(); index > 0; index--) {
+            if (m_writes[index - 1].address == address) {
+                return &m_writes[index - 1];
+            }
+        }
+
+        return NULL;
+    }
+
+    uint64_t readWord(const Word *address) {
+        uint64_t pending = 0;
+        uint64_t pendingMask = 0;
+        const WriteEntry *entry = findWrite(address);
+        if (entry != NULL) {
+            if (entry->mask == FULL_MASK) {
+                return entry->value;
+            }
+
+            pending = entry->value;
+            pendingMask = entry->mask;
+        }
+
+        Runtime& runtime = Runtime::instance();
+        std::atomic<uint64_t>& orec = runtime.orec(address);
+        uint64_t before = orec.load(std::memory_order_acquire);
+        if ((before & LOCKED) && runtime.config().contention == CM_WAIT) {
+            SpinWait spin;
+            for (size_t spins = 0; (before & LOCKED) && spins < WAIT_SPINS; spins++) {
+                spin.wait();
+                before = orec.load(std::memory_order_acquire);
+            }
+        }
+
+        if (before & LOCKED) {
+            abort(ABORT_LOCKED_READ);
+        }
+
+        const uint64_t value = __atomic_load_n(address, __ATOMIC_RELAXED);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t after = orec.load(std::memory_order_relaxed);
+        if (after != before) {
+            abort((after & LOCKED) ? ABORT_LOCKED_READ : ABORT_VALIDATE_READ);
+        }
+
+        if ((before >> 1) > m_readVersion) {
+            abort(ABORT_VALIDATE_READ);
+        }
+
+        m_reads.push_back(&orec);
+        return (value & ~pendingMask) | pending;
+    }
+
+    void writeWord(Word *address, uint64_t value, uint64_t mask) {
+        WriteEntry *entry = findWrite(address);
+        if (entry != NULL) {
+            entry->value = (entry->value & ~mask) | value;
+            entry->mask |= mask;
+        } else {
+            m_writes.push_back(WriteEntry(address, value, mask));
+            m_writeFilter |= filterBit(address);
+        }
+    }
+
+    /**
+     * Orecs locked by this transaction are checked against their
+     * versions before the lock
+     */
+    void validate() {
+        for (const std::atomic<uint64_t> *orec: m_reads) {
+            uint64_t value = orec->load(std::memory_order_acquire);
+            if (value == lockValue()) {
+                value = previousOf(orec);
+            } else if (value & LOCKED) {
+                abort(ABORT_VALIDATE_COMMIT);
+            }
+
+            if ((value >> 1) > m_readVersion) {
+                abort(ABORT_VALIDATE_COMMIT);
+            }
+        }
+    }
+
+    uint64_t previousOf(const std::atomic<uint64_t> *orec) const {
+        for (const LockedOrec& locked: m_locked) {
+            if (locked.orec == orec) {
+                return locked.previous;
+            }
+        }
+
+        return 0;
+    }
+
+    __attribute__((noreturn))
+    void abort(AbortReason reason) {
+        for (const LockedOrec& locked: m_locked) {
+            locked.orec->store(locked.previous, std::memory_order_release);
+        }
+
+        for (void *memory: m_allocated) {
+            free(memory);
+        }
+
+        m_consecutiveAborts++;
+        clear();
+
+        if (Runtime::instance().config().contention == CM_BACKOFF) {
+            const size_t shift = (m_consecutiveAborts < MAX_BACKOFF_SHIFT) ?
+                    m_consecutiveAborts : MAX_BACKOFF_SHIFT;
+            const size_t delay = m_random() % (BACKOFF_UNIT << shift);
+            SpinWait spin;
+            for (size_t step = 0; step < delay; step++) {
+                spin.wait();
+            }
+        }
+
+        Abort abort;
+        abort.reason = reason;
+        throw abort;
+    }
+
+    /**
+     * Frees the limbo memory which no running transaction began before
+     */
+    void reclaim() {
+        const uint64_t oldest = Runtime::instance().oldestEpoch();
+        size_t kept = 0;
+        for (const Retired& retired: m_limbo) {
+            if (retired.epoch <= oldest) {
+                free(retired.memory);
+            } else {
+                m_limbo[kept++] = retired;
+            }
+        }
+
+        m_limbo.resize(kept, Retired(0, NULL));
+    }
+
+    void finish() {
+        m_consecutiveAborts = 0;
+        clear();
+    }
+
+    void clear() {
+        m_isActive = false;
+        m_epoch.store(Runtime::IDLE_EPOCH, std::memory_order_release);
+        m_reads.clear();
+        m_writes.clear();
+        m_writeFilter = 0;
+        m_locked.clear();
+        m_allocated.clear();
+        m_released.clear();
+    }
+
+    bool m_isActive;
+    uint64_t m_readVersion;
+    std::vector<const std::atomic<uint64_t>*> m_reads;
+    std::vector<WriteEntry> m_writes;
+    // bloom filter of written words, makes most reads skip the redo log
+    uint64_t m_writeFilter;
+    std::vector<LockedOrec> m_locked;
+    std::vector<void*> m_allocated;
+    std::vector<void*> m_released;
+    std::vector<Retired> m_limbo;
+    size_t m_consecutiveAborts;
+    Random m_random;
+    char m_padding0[CACHE_LINE_SIZE];
+    // read by reclaim() of other threads
+    std::atomic<uint64_t> m_epoch;
+    char m_padding1[CACHE_LINE_SIZE];
+};
+
+/*
+ * Explicit transactional API of the calling thread
+ */
+
+static inline void txBegin() {
+    Transaction::current().begin();
+}
+
+static inline void txCommit() {
+    Transaction::current().commit();
+}
+
+template<class T>
+T txRead(const T *address) {
+    Transaction& transaction = Transaction::current();
+    return transaction.isActive() ? transaction.read(address) : *address;
+}
+
+template<class T>
+void txWrite(T *address, const T& value) {
+    Transaction& transaction = Transaction::current();
+    if (transaction.isActive()) {
+        transaction.write(address, value);
+    } else {
+        *address = value;
+    }
+}
+
+static inline void *txAlloc(size_t size) {
+    return Transaction::current().allocate(size);
+}
+
+static inline void txFree(void *memory, size_t size) {
+    Transaction::current().release(memory, size);
+}
+
+/**
+ * Field of a shared object, every access goes through txRead()/txWrite()
+ */
+template<class T>
+class Shared {
+public:
+    Shared() = default;
+
+    operator T() const {
+        return txRead(&m_value);
+    }
+
+    // for pointer fields
+    T operator->() const {
+        return txRead(&m_value);
+    }
+
+    Shared& operator=(const T& value) {
+        txWrite(&m_value, value);
+        return *this;
+    }
+
+    Shared& operator=(const Shared& other) {
+        txWrite(&m_value, txRead(&other.m_value));
+        return *this;
+    }
+
+protected:
+    T m_value;
+};
+
+/**
+ * Instrumented accesses for containers (see MemoryAccess.h)
+ */
+struct Access {
+    template<class T>
+    using Field = Shared<T>;
+
+    template<class T>
+    static T load(const Shared<T>& field) {
+        return field;
+    }
+
+    template<class T>
+    static T *create() {
+        return new (txAlloc(sizeof(T))) T();
+    }
+
+    template<class T>
+    static void destroy(T *object) {
+        object->~T();
+        txFree(object, sizeof(T));
+    }
+};
+
+} // namespace STM
+} // namespace Utils
+
+#endif // STM_H
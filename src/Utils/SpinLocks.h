@@ -0,0 +1,362 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef SPINLOCKS_H
+#define SPINLOCKS_H
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <x86intrin.h>
+#include <atomic>
+
+namespace Utils {
+
+/*
+ * Locks used as critical section backends (see Locks::Lock in Common.h).
+ * All of them have lock() and unlock() methods. Lock words are surrounded
+ * by padding, so they don't share cache lines with neighbouring data.
+ */
+
+static const size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * Busy-wait loop step. After SPINS_BEFORE_YIELD steps the CPU is given
+ * away on every step: with more threads than CPUs the lock holder (or the
+ * next waiter of a queue lock) may be preempted, and spinning only delays it.
+ */
+class SpinWait {
+public:
+    static const size_t SPINS_BEFORE_YIELD = 512;
+
+    SpinWait() {
+        m_spins = 0;
+    }
+
+    void reset() {
+        m_spins = 0;
+    }
+
+    void wait() {
+        if (m_spins < SPINS_BEFORE_YIELD) {
+            m_spins++;
+            _mm_pause();
+        } else {
+            sched_yield();
+        }
+    }
+
+protected:
+    size_t m_spins;
+};
+
+/**
+ * Test-and-test-and-set spin lock with exponential backoff
+ */
+class TTASLock {
+public:
+    TTASLock() {
+        m_locked.store(false);
+    }
+
+    // disable evil constructors
+    TTASLock(const TTASLock& lock);
+    TTASLock& operator=(const TTASLock& lock);
+
+    void lock() {
+        size_t backoff = MIN_BACKOFF;
+        SpinWait spin;
+        while (true) {
+            while (m_locked.load(std::memory_order_relaxed)) {
+                spin.wait();
+            }
+
+            if (!m_locked.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+
+            for (size_t i = 0; i < backoff; i++) {
+                spin.wait();
+            }
+
+            backoff = (2 * backoff < MAX_BACKOFF) ? 2 * backoff : MAX_BACKOFF;
+        }
+    }
+
+    void unlock() {
+        m_locked.store(false, std::memory_order_release);
+    }
+
+protected:
+    // pause instructions
+    static const size_t MIN_BACKOFF = 4;
+    static const size_t MAX_BACKOFF = 1024;
+
+    char m_padBefore[CACHE_LINE_SIZE];
+    std::atomic<bool> m_locked;
+    char m_padAfter[CACHE_LINE_SIZE];
+};
+
+/**
+ * FIFO ticket lock, waiters back off proportionally to their place in line
+ */
+class TicketLock {
+public:
+    TicketLock() {
+        m_next.store(0);
+        m_serving.store(0);
+    }
+
+    // disable evil constructors
+    TicketLock(const TicketLock& lock);
+    TicketLock& operator=(const TicketLock& lock);
+
+    void lock() {
+        const uint32_t ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+        SpinWait spin;
+        while (true) {
+            const uint32_t serving = m_serving.load(std::memory_order_acquire);
+            if (serving == ticket) {
+                return;
+            }
+
+            for (uint32_t i = 0; i < (ticket - serving) * BACKOFF_PER_WAITER; i++) {
+                spin.wait();
+            }
+        }
+    }
+
+    void unlock() {
+        // only the owner writes m_serving
+        m_serving.store(m_serving.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+    }
+
+protected:
+    static const uint32_t BACKOFF_PER_WAITER = 16;
+
+    char m_padBefore[CACHE_LINE_SIZE];
+    std::atomic<uint32_t> m_next;
+    std::atomic<uint32_t> m_serving;
+    char m_padAfter[CACHE_LINE_SIZE];
+};
+
+/**
+ * MCS queue lock: every waiter spins on a flag in its own node.
+ * Nodes are thread-local and shared by all MCS locks, so a thread can't
+ * hold two of them at the same time.
+ */
+class MCSLock {
+public:
+    MCSLock() {
+        m_tail.store(NULL);
+    }
+
+    // disable evil constructors
+    MCSLock(const MCSLock& lock);
+    MCSLock& operator=(const MCSLock& lock);
+
+    void lock() {
+        Node& node = currentNode();
+        node.next.store(NULL, std::memory_order_relaxed);
+        node.locked.store(true, std::memory_order_relaxed);
+
+        Node *pred = m_tail.exchange(&node, std::memory_order_acq_rel);
+        if (pred != NULL) {
+            pred->next.store(&node, std::memory_order_release);
+            SpinWait spin;
+            while (node.locked.load(std::memory_order_acquire)) {
+                spin.wait();
+            }
+        }
+    }
+
+    void unlock() {
+        Node& node = currentNode();
+        Node *succ = node.next.load(std::memory_order_acquire);
+        if (succ == NULL) {
+            Node *expected = &node;
+            if (m_tail.compare_exchange_strong(expected, NULL, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+                return;
+            }
+
+            // the successor has swapped the tail, but hasn't linked itself yet
+            SpinWait spin;
+            while ((succ = node.next.load(std::memory_order_acquire)) == NULL) {
+                spin.wait();
+            }
+        }
+
+        succ->locked.store(false, std::memory_order_release);
+    }
+
+protected:
+    struct Node {
+        std::atomic<Node *> next;
+        std::atomic<bool> locked;
+        char padding[CACHE_LINE_SIZE];
+    };
+
+    static Node& currentNode() {
+        static thread_local Node node;
+        return node;
+    }
+
+    char m_padBefore[CACHE_LINE_SIZE];
+    std::atomic<Node *> m_tail;
+    char m_padAfter[CACHE_LINE_SIZE];
+};
+
+/**
+ * CLH queue lock: every waiter spins on the node of its predecessor and
+ * takes that node after unlock(). A thread owns one node at a time
+ * (shared by all CLH locks), the lock owns the tail node.
+ */
+class CLHLock {
+public:
+    CLHLock() {
+        m_tail.store(new Node());
+    }
+
+    ~CLHLock() {
+        delete m_tail.load();
+    }
+
+    // disable evil constructors
+    CLHLock(const CLHLock& lock);
+    CLHLock& operator=(const CLHLock& lock);
+
+    void lock() {
+        ThreadState& state = currentState();
+        state.node->locked.store(true, std::memory_order_relaxed);
+        state.pred = m_tail.exchange(state.node, std::memory_order_acq_rel);
+        SpinWait spin;
+        while (state.pred->locked.load(std::memory_order_acquire)) {
+            spin.wait();
+        }
+    }
+
+    void unlock() {
+        ThreadState& state = currentState();
+        Node *node = state.node;
+        state.node = state.pred;
+        node->locked.store(false, std::memory_order_release);
+    }
+
+protected:
+    struct Node {
+        Node() {
+            locked.store(false);
+        }
+
+        std::atomic<bool> locked;
+        char padding[CACHE_LINE_SIZE];
+    };
+
+    struct ThreadState {
+        ThreadState() {
+            node = new Node();
+            pred = NULL;
+        }
+
+        ~ThreadState() {
+            delete node;
+        }
+
+        Node *node;
+        Node *pred;
+    };
+
+    static ThreadState& currentState() {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    char m_padBefore[CACHE_LINE_SIZE];
+    std::atomic<Node *> m_tail;
+    char m_padAfter[CACHE_LINE_SIZE];
+};
+
+/**
+ * Mutex which spins for a while and then sleeps on a futex
+ * (0 - unlocked, 1 - locked, 2 - locked and there may be sleepers)
+ */
+class FutexMutex {
+public:
+    FutexMutex() {
+        m_state.store(0);
+    }
+
+    // disable evil constructors
+    FutexMutex(const FutexMutex& mutex);
+    FutexMutex& operator=(const FutexMutex& mutex);
+
+    void lock() {
+        for (size_t i = 0; i < SPIN_COUNT; i++) {
+            int expected = 0;
+            if (m_state.load(std::memory_order_relaxed) == 0 &&
+                    m_state.compare_exchange_weak(expected, 1, std::memory_order_acquire)) {
+                return;
+            }
+
+            _mm_pause();
+        }
+
+        while (m_state.exchange(2, std::memory_order_acquire) != 0) {
+            futex(FUTEX_WAIT_PRIVATE, 2);
+        }
+    }
+
+    void unlock() {
+        if (m_state.exchange(0, std::memory_order_release) == 2) {
+            futex(FUTEX_WAKE_PRIVATE, 1);
+        }
+    }
+
+protected:
+    static const size_t SPIN_COUNT = 100;
+
+    void futex(int operation, int value) {
+        syscall(SYS_futex, reinterpret_cast<int *>(&m_state), operation, value,
+                NULL, NULL, 0);
+    }
+
+    char m_padBefore[CACHE_LINE_SIZE];
+    std::atomic<int> m_state;
+    char m_padAfter[CACHE_LINE_SIZE];
+};
+
+} // namespace Utils
+
+#endif // SPINLOCKS_H
@@ -0,0 +1,172 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "Random.h"
+
+namespace Utils {
+
+/**
+ * Descriptive statistics of a small sample (e.g. results of repetitions)
+ */
+class Statistics {
+public:
+    Statistics(const std::vector<double>& values) {
+        m_values = values;
+        m_sorted = values;
+        std::sort(m_sorted.begin(), m_sorted.end());
+    }
+
+    size_t count() const {
+        return m_values.size();
+    }
+
+    double min() const {
+        return m_sorted.empty() ? 0.0 : m_sorted.front();
+    }
+
+    double max() const {
+        return m_sorted.empty() ? 0.0 : m_sorted.back();
+    }
+
+    double mean() const {
+        return mean(m_values);
+    }
+
+    double median() const {
+        return quantile(0.5);
+    }
+
+    /**
+     * Sample standard deviation
+     */
+    double stddev() const {
+        if (m_values.size() < 2) {
+            return 0.0;
+        }
+
+        const double m = mean();
+        double sum = 0.0;
+        for(size_t i = 0; i < m_values.size(); i++) {
+            sum += (m_values[i] - m) * (m_values[i] - m);
+        }
+
+        return sqrt(sum / (m_values.size() - 1));
+    }
+
+    /**
+     * Quantile with linear interpolation between closest ranks
+     */
+    double quantile(double q) const {
+        if (m_sorted.empty()) {
+            return 0.0;
+        }
+
+        const double pos = q * (m_sorted.size() - 1);
+        const size_t lower = static_cast<size_t>(floor(pos));
+        const size_t upper = std::min(lower + 1, m_sorted.size() - 1);
+        return m_sorted[lower] + (pos - lower) * (m_sorted[upper] - m_sorted[lower]);
+    }
+
+    /**
+     * Percentile bootstrap confidence interval of the mean
+     */
+    void bootstrap(double confidence, uint64_t seed, double *low, double *high,
+                   size_t resamples = 2000) const {
+        if (m_values.size() < 2) {
+            *low = *high = mean();
+            return;
+        }
+
+        Random random(seed);
+        std::vector<double> means(resamples);
+        std::vector<double> resample(m_values.size());
+        for(size_t r = 0; r < resamples; r++) {
+            for(size_t i = 0; i < resample.size(); i++) {
+                resample[i] = m_values[random.uniform(m_values.size())];
+            }
+
+            means[r] = mean(resample);
+        }
+
+        const Statistics meansStats(means);
+        *low = meansStats.quantile((1.0 - confidence) / 2.0);
+        *high = meansStats.quantile((1.0 + confidence) / 2.0);
+    }
+
+    /**
+     * Indexes of values outside of Tukey's fences (1.5 IQR)
+     */
+    std::vector<size_t> outliers() const {
+        std::vector<size_t> result;
+        if (m_values.size() < 4) {
+            return result;
+        }
+
+        const double q1 = quantile(0.25);
+        const double q3 = quantile(0.75);
+        const double iqr = q3 - q1;
+        for(size_t i = 0; i < m_values.size(); i++) {
+            if (m_values[i] < q1 - 1.5 * iqr || m_values[i] > q3 + 1.5 * iqr) {
+                result.push_back(i);
+            }
+        }
+
+        return result;
+    }
+
+protected:
+    static double mean(const std::vector<double>& values) {
+        if (values.empty()) {
+            return 0.0;
+        }
+
+        double sum = 0.0;
+        for(size_t i = 0; i < values.size(); i++) {
+            sum += values[i];
+        }
+
+        return sum / values.size();
+    }
+
+    std::vector<double> m_values;
+    std::vector<double> m_sorted;
+};
+
+} // namespace Utils
+
+#endif // STATISTICS_H
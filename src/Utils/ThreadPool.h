@@ -0,0 +1,286 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <string>
+
+#include <Utils/PerfCounters.h>
+
+namespace Utils {
+
+/**
+ * Pool of persistent worker threads.
+ *
+ * Workers are parked between runs and released together by a start barrier,
+ * so thread creation and wake-up latency are not included into the measured
+ * interval.
+ */
+class ThreadPool {
+public:
+    typedef std::function<void (size_t)> Task;
+    typedef std::function<void ()> Monitor;
+    typedef std::chrono::steady_clock Clock;
+
+    ThreadPool() {
+        m_generation = 0;
+        m_running = 0;
+        m_shutdown = false;
+        m_perfEnabled = false;
+    }
+
+    ~ThreadPool() {
+        resize(0);
+    }
+
+    // disable evil constructors
+    ThreadPool(const ThreadPool& pool);
+    ThreadPool& operator=(const ThreadPool& pool);
+
+    /**
+     * Start or stop workers to have exactly threadsCount of them
+     */
+    void resize(size_t threadsCount) {
+        if (threadsCount == m_threads.size()) {
+            return;
+        }
+
+        // stop all workers and start a new set of them
+        {
+            std::lock_guard<std::mutex> locker(m_mutex);
+            m_shutdown = true;
+        }
+        m_wakeup.notify_all();
+
+        for(size_t threadId = 0; threadId < m_threads.size(); threadId++) {
+            m_threads[threadId].join();
+        }
+
+        m_threads.clear();
+        m_shutdown = false;
+        // new workers start waiting for generation 1
+        m_generation = 0;
+        m_finishTimes.resize(threadsCount);
+        m_perfValues.resize(threadsCount);
+
+        for(size_t threadId = 0; threadId < threadsCount; threadId++) {
+            m_threads.push_back(std::thread(std::bind(&ThreadPool::loop,
+                                                      this, threadId)));
+        }
+    }
+
+    size_t size() const {
+        return m_threads.size();
+    }
+
+    /**
+     * Finish time of every worker in the last run, relative to barrier release
+     */
+    std::vector<std::chrono::nanoseconds> finishTimes() const {
+        std::vector<std::chrono::nanoseconds> result;
+        for(size_t threadId = 0; threadId < m_finishTimes.size(); threadId++) {
+            result.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 m_finishTimes[threadId] - m_startTime));
+        }
+
+        return result;
+    }
+
+    /**
+     * Count performance events of workers during next runs
+     */
+    void setPerfCounters(bool isEnabled) {
+        m_perfEnabled = isEnabled;
+    }
+
+    /**
+     * Events counted by every worker during the last run
+     */
+    const std::vector<PerfCounters::Values>& perfCounters() const {
+        return m_perfValues;
+    }
+
+    /**
+     * Reason why some performance counters are unavailable
+     */
+    std::string perfError() const {
+        std::lock_guard<std::mutex> locker(m_mutex);
+        return m_perfError;
+    }
+
+    /**
+     * Id of the calling worker thread (0 outside of the pool)
+     */
+    static size_t threadId() {
+        return currentThreadId();
+    }
+
+    /**
+     * Run task(threadId) on every worker and wait for completion.
+     * The optional monitor is executed by the calling thread while
+     * workers are running.
+     * Returns time between barrier release and finish of the last worker.
+     */
+    std::chrono::nanoseconds run(const Task& task, const Monitor& monitor = Monitor()) {
+        if (m_threads.empty()) {
+            return std::chrono::nanoseconds(0);
+        }
+
+        std::unique_lock<std::mutex> locker(m_mutex);
+        m_task = task;
+        m_arrived.store(0);
+        m_released.store(false);
+        m_running = m_threads.size();
+        m_perfValues.assign(m_threads.size(), PerfCounters::Values());
+        m_generation++;
+        m_wakeup.notify_all();
+
+        if (monitor) {
+            locker.unlock();
+            monitor();
+            locker.lock();
+        }
+
+        while (m_running > 0) {
+            m_done.wait(locker);
+        }
+
+        m_task = Task();
+
+        Clock::time_point finishTime = m_startTime;
+        for(size_t threadId = 0; threadId < m_finishTimes.size(); threadId++) {
+            finishTime = std::max(finishTime, m_finishTimes[threadId]);
+        }
+
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    finishTime - m_startTime);
+    }
+
+protected:
+    static size_t& currentThreadId() {
+        static thread_local size_t threadId = 0;
+        return threadId;
+    }
+
+    void loop(size_t threadId) {
+        size_t generation = 0;
+        currentThreadId() = threadId;
+
+        // counters of this thread, opened on the first use
+        PerfCounters counters;
+        bool isPerfOpened = false;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> locker(m_mutex);
+                while (!m_shutdown && m_generation == generation) {
+                    m_wakeup.wait(locker);
+                }
+
+                if (m_shutdown) {
+                    return;
+                }
+
+                generation = m_generation;
+
+                if (m_perfEnabled && !isPerfOpened) {
+                    isPerfOpened = true;
+                    counters.open();
+                    if (!counters.error().empty()) {
+                        m_perfError = counters.error();
+                    }
+                }
+            }
+
+            const bool isCounting = m_perfEnabled;
+
+            // start barrier: the last arrived worker releases everyone
+            if (m_arrived.fetch_add(1) + 1 == m_threads.size()) {
+                m_startTime = Clock::now();
+                m_released.store(true, std::memory_order_release);
+            } else {
+                while (!m_released.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+            }
+
+            if (isCounting) {
+                counters.start();
+            }
+
+            m_task(threadId);
+
+            m_finishTimes[threadId] = Clock::now();
+
+            if (isCounting) {
+                counters.stop(&m_perfValues[threadId]);
+            }
+
+            {
+                std::lock_guard<std::mutex> locker(m_mutex);
+                m_running--;
+                if (m_running == 0) {
+                    m_done.notify_one();
+                }
+            }
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::vector<Clock::time_point> m_finishTimes;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::condition_variable m_done;
+    size_t m_generation;
+    size_t m_running;
+    bool m_shutdown;
+    Task m_task;
+    bool m_perfEnabled;
+    std::vector<PerfCounters::Values> m_perfValues;
+    std::string m_perfError;
+
+    std::atomic<size_t> m_arrived;
+    std::atomic<bool> m_released;
+    Clock::time_point m_startTime;
+};
+
+} // namespace Utils
+
+#endif // THREADPOOL_H
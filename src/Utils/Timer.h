@@ -0,0 +1,135 @@
+/*
+ * (с) 2011 Roman Tsisyk <roman@tsisyk.com>
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above
+ * copyright notice, this list of conditions and the
+ * following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following
+ * disclaimer in the documentation and/or other materials
+ * provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY <COPYRIGHT HOLDER> ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * <COPYRIGHT HOLDER> OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ * THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <cpuid.h>
+#include <x86intrin.h>
+
+namespace Utils {
+
+/**
+ * Time stamp counter calibrated against CLOCK_MONOTONIC once per process.
+ *
+ * Reading the TSC costs a few dozen cycles instead of a clock_gettime()
+ * call, so it can be used around every operation. Cycles are converted
+ * to nanoseconds with the calibrated frequency, which is only meaningful
+ * if the TSC is invariant (doesn't depend on frequency scaling and sleep
+ * states), see isInvariant().
+ */
+class Timer {
+public:
+    static const Timer& instance() {
+        static const Timer timer;
+        return timer;
+    }
+
+    /**
+     * May be executed before preceding instructions complete,
+     * use at the start of a measured interval
+     */
+    static uint64_t cycles() {
+        return __rdtsc();
+    }
+
+    /**
+     * Waits for preceding instructions, use at the end of a measured interval
+     */
+    static uint64_t cyclesAfter() {
+        unsigned int aux;
+        return __rdtscp(&aux);
+    }
+
+    bool isInvariant() const {
+        return m_isInvariant;
+    }
+
+    /**
+     * TSC frequency (GHz)
+     */
+    double cyclesPerNs() const {
+        return m_cyclesPerNs;
+    }
+
+    double toNs(double cycles) const {
+        return cycles / m_cyclesPerNs;
+    }
+
+    uint64_t toNs(uint64_t cycles) const {
+        return static_cast<uint64_t>(cycles / m_cyclesPerNs);
+    }
+
+    // disable evil constructors
+    Timer(const Timer& timer);
+    Timer& operator=(const Timer& timer);
+
+protected:
+    static const uint64_t CALIBRATION_NS = 20000000;
+
+    Timer() {
+        // CPUID.80000007H:EDX[8]
+        unsigned int eax, ebx, ecx, edx;
+        m_isInvariant = __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+                (edx & (1 << 8)) != 0;
+
+        uint64_t ns0, ns1;
+        const uint64_t cycles0 = sample(&ns0);
+        const struct timespec pause = { 0, (long) CALIBRATION_NS };
+        nanosleep(&pause, NULL);
+        const uint64_t cycles1 = sample(&ns1);
+
+        m_cyclesPerNs = (ns1 > ns0 && cycles1 > cycles0) ?
+                    (double) (cycles1 - cycles0) / (ns1 - ns0) : 1.0;
+    }
+
+    /**
+     * Read both clocks, the TSC is taken in the middle of clock_gettime()
+     */
+    static uint64_t sample(uint64_t *ns) {
+        struct timespec time;
+        const uint64_t before = cyclesAfter();
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        const uint64_t after = cyclesAfter();
+
+        *ns = (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+        return before + (after - before) / 2;
+    }
+
+    bool m_isInvariant;
+    double m_cyclesPerNs;
+};
+
+} // namespace Utils
+
+#endif // TIMER_H
@@ -39,11 +39,12 @@ namespace Utils {
 /**
  * Map implementation based on RBTree
  */
-template<class KeyTypeParam, class ValueTypeParam>
+template<class KeyTypeParam, class ValueTypeParam, class AccessParam = DirectAccess>
 class TreeMap {
 public:
     typedef KeyTypeParam KeyType;
     typedef ValueTypeParam ValueType;
+    typedef AccessParam Access;
 
     class Iterator;
 
@@ -137,7 +138,7 @@ public:
     Iterator removeAll(const KeyType& key) {
         TreeNode *node = NULL;
 
-        for (node = m_tree.find(MapNode(key)); node != NULL && node->key.key() == key; ) {
+        for (node = m_tree.find(MapNode(key)); node != NULL && Access::load(node->key).key() == key; ) {
             node = m_tree.remove(node);
         }
 
@@ -147,7 +148,7 @@ public:
     ValueType take(const KeyType& key) {
         TreeNode *node = m_tree.find(MapNode(key));
         if (node != NULL) {
-            const ValueType result = node->key.value();
+            const ValueType result = Access::load(node->key).value();
             m_tree.remove(node);
             return result;
         } else {
@@ -167,6 +168,27 @@ public:
         return  begin() == end();
     }
 
+#ifdef CONTAINER_HEATMAP
+    Heatmap& heatmap() {
+        return m_tree.heatmap();
+    }
+#endif
+
+    ContainerStats stats() const {
+        return m_tree.stats();
+    }
+
+    /**
+     * Call function(key, value) for nodes of the part of the tree,
+     * parts are disjoint and together cover all nodes
+     */
+    template<class Function>
+    void forEach(size_t part, size_t partsCount, Function function) const {
+        m_tree.forEach(part, partsCount, [&](const MapNode& node) {
+            function(node.key(), node.value());
+        });
+    }
+
 protected:
     class MapNode {
     public:
@@ -219,8 +241,8 @@ protected:
         ValueType m_value;
     };
 
-    typedef Private::RBTree<MapNode> Tree;
-    typedef typename Private::RBTree<MapNode>::Node TreeNode;
+    typedef Private::RBTree<MapNode, AccessParam> Tree;
+    typedef typename Tree::Node TreeNode;
 
 public:
     /**
@@ -260,16 +282,18 @@ public:
             return !operator==(it);
         }
 
-        const KeyType& key() const {
-            return m_node->key.key();
+        KeyType key() const {
+            return Access::load(m_node->key).key();
         }
 
-        const ValueType& value() const {
-            return m_node->key.value();
+        ValueType value() const {
+            return Access::load(m_node->key).value();
         }
 
         void setValue(const ValueType& value) {
-            m_node->key.setValue(value);
+            MapNode node = Access::load(m_node->key);
+            node.setValue(value);
+            m_node->key = node;
         }
 
     protected:
@@ -39,10 +39,11 @@ namespace Utils {
 /**
  * Set implementation based on RBTree
  */
-template<class KeyTypeParam>
+template<class KeyTypeParam, class AccessParam = DirectAccess>
 class TreeSet {
 public:
     typedef KeyTypeParam KeyType;
+    typedef AccessParam Access;
     class Iterator;
 
     TreeSet() {
@@ -78,7 +79,7 @@ public:
     }
 
     bool contains(const KeyType& key) const {
-        return (m_tree.find(key) != end());
+        return (m_tree.find(key) != NULL);
     }
 
     size_t count(const KeyType& key) const {
@@ -109,7 +110,7 @@ public:
     Iterator removeAll(const KeyType& key) {
         TreeNode *node = NULL;
 
-        for (node = m_tree.find(key); node != NULL && node->key == key; ) {
+        for (node = m_tree.find(key); node != NULL && Access::load(node->key) == key; ) {
             node = m_tree.remove(node);
         }
 
@@ -139,9 +140,28 @@ public:
         return  begin() == end();
     }
 
+#ifdef CONTAINER_HEATMAP
+    Heatmap& heatmap() {
+        return m_tree.heatmap();
+    }
+#endif
+
+    ContainerStats stats() const {
+        return m_tree.stats();
+    }
+
+    /**
+     * Call function(key) for nodes of the part of the tree,
+     * parts are disjoint and together cover all nodes
+     */
+    template<class Function>
+    void forEach(size_t part, size_t partsCount, Function function) const {
+        m_tree.forEach(part, partsCount, function);
+    }
+
 protected:
-    typedef Private::RBTree<KeyTypeParam> Tree;
-    typedef typename Private::RBTree<KeyTypeParam>::Node TreeNode;
+    typedef Private::RBTree<KeyTypeParam, AccessParam> Tree;
+    typedef typename Tree::Node TreeNode;
 
 public:
     /**
@@ -181,11 +201,11 @@ public:
             return !operator==(it);
         }
 
-        const KeyType& key() const {
+        KeyType key() const {
             return m_node->key;
         }
 
-        const KeyType& operator*() const {
+        KeyType operator*() const {
             return key();
         }
 
@@ -32,6 +32,10 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include <new>
+
+#include <Utils/ContainerStats.h>
+
 namespace Utils {
 
 /**
@@ -47,20 +51,20 @@ public:
     Vector() {
         m_size = 0;
         m_capacity = 10;
-        m_data = new ValueType[m_capacity];
+        m_data = allocate(m_capacity);
     }
 
     __attribute__((transaction_safe))
     virtual ~Vector() {
         clear();
-        delete [] m_data;
+        deallocate(m_data, m_capacity);
     }
 
     __attribute__((transaction_safe))
     Vector(const Vector& vec) {
         m_size = 0;
         m_capacity = 0;
-        m_data = new ValueType[m_capacity];
+        m_data = allocate(m_capacity);
 
         *this = vec;
     }
@@ -154,12 +158,12 @@ public:
             return;
         }
 
-        ValueType *data = new ValueType[capacity];
+        ValueType *data = allocate(capacity);
         for(size_t i = 0; i < m_size; i++) {
             data[i] = m_data[i];
         }
 
-        delete[] m_data;
+        deallocate(m_data, m_capacity);
         m_data = data;
         m_capacity = capacity;
     }
@@ -204,7 +208,54 @@ public:
         return size() == 0;
     }
 
+    /**
+     * Capacity usage and memory footprint, not thread-safe
+     */
+    ContainerStats stats() const {
+        ContainerStats result("vector");
+        result.size = m_size;
+        result.capacity = m_capacity;
+        result.loadFactor = m_capacity > 0 ? (double) m_size / m_capacity : 0.0;
+        result.bytes = ContainerStats::allocated(m_capacity * sizeof(ValueType));
+        return result;
+    }
+
+    /**
+     * Call function(value) for elements of the part of the vector,
+     * parts are disjoint and together cover all elements
+     */
+    template<class Function>
+    void forEach(size_t part, size_t partsCount, Function function) const {
+        const size_t start = m_size * part / partsCount;
+        const size_t end = m_size * (part + 1) / partsCount;
+        for(size_t i = start; i < end; i++) {
+            function(m_data[i]);
+        }
+    }
+
 protected:
+    /*
+     * new[] with a non-constant size may throw std::bad_array_new_length,
+     * which is not transaction-safe in recent GCC versions
+     */
+    static ValueType *allocate(size_t capacity) {
+        ValueType *data = static_cast<ValueType *>(
+                    ::operator new(capacity * sizeof(ValueType)));
+        for(size_t i = 0; i < capacity; i++) {
+            new (data + i) ValueType();
+        }
+
+        return data;
+    }
+
+    static void deallocate(ValueType *data, size_t capacity) {
+        for(size_t i = 0; i < capacity; i++) {
+            data[i].~ValueType();
+        }
+
+        ::operator delete(data);
+    }
+
     ValueType *m_data;
     size_t m_size;
     size_t m_capacity;
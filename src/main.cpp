@@ -31,10 +31,16 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <vector>
 #include <set>
 #include <map>
 #include <chrono>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <limits>
 
 // Tests
 #include "Tests/ArraySumTest.h"
@@ -43,33 +49,738 @@
 #include "Tests/TreeInsertTest.h"
 #include "Tests/TreeRemoveTest.h"
 #include "Tests/HashInsertTest.h"
+#include "Tests/MixedWorkloadTest.h"
+
+#include <Utils/Statistics.h>
+#include <Utils/Environment.h>
+#include <Utils/ResultWriter.h>
+#include <Utils/Timer.h>
 // #include "Tests/BankTest.h"
 
 using namespace std;
 
-typedef map< string, function<ITest* (void)> > TestsMap;
+/*
+ * Backend of config lines without backend= (make BACKEND=NAME)
+ */
+#ifndef DEFAULT_BACKEND
+#define DEFAULT_BACKEND "tm"
+#endif
+
+/*
+ * Available critical section backends (see Common.h)
+ */
+static const vector<string> BACKENDS = {
+    "none", "mutex", "ttas", "ticket", "mcs", "clh", "futex", "fc", "delegation", "tm", "stm",
+    "adaptive", "adaptive-mcs"
+};
+
+template< template<class> class TestType >
+static ITest *createTest(const string& backend) {
+    if (backend == "none") {
+        return new TestType<Locks::None>();
+    } else if (backend == "mutex") {
+        return new TestType<Locks::Mutex>();
+    } else if (backend == "ttas") {
+        return new TestType<Locks::TTAS>();
+    } else if (backend == "ticket") {
+        return new TestType<Locks::Ticket>();
+    } else if (backend == "mcs") {
+        return new TestType<Locks::MCS>();
+    } else if (backend == "clh") {
+        return new TestType<Locks::CLH>();
+    } else if (backend == "futex") {
+        return new TestType<Locks::Futex>();
+    } else if (backend == "fc") {
+        return new TestType<Locks::FlatCombining>();
+    } else if (backend == "delegation") {
+        return new TestType<Locks::Delegation>();
+    } else if (backend == "tm") {
+        return new TestType<Locks::TM>();
+    } else if (backend == "adaptive") {
+        return new TestType<Locks::AdaptiveFutex>();
+    } else if (backend == "adaptive-mcs") {
+        return new TestType<Locks::AdaptiveMCS>();
+    } else if (backend == "stm") {
+        // only tests which access shared data through Locks::STM::Access
+        return TestType<Locks::STM>::INSTRUMENTED ? new TestType<Locks::STM>() : NULL;
+    } else {
+        return NULL;
+    }
+}
+
+typedef map< string, function<ITest* (const string& backend)> > TestsMap;
 
 static const TestsMap TESTS = {
-    { "ArraySumTest", [] { return new ArraySumTest(); } },
-    { "ArrayInsertTest", [] { return new ArrayInsertTest(); } },
-    { "ListInsertTest", [] { return new ListInsertTest(); } },
-    { "TreeInsertTest", [] { return new TreeInsertTest(); } },
-    { "TreeRemoveTest", [] { return new TreeRemoveTest(); } },
-    { "HashInsertTest", [] { return new HashInsertTest(); } },
-//    { "BankTest", [] { return new BankTest(); } },
+    { "ArraySumTest", createTest<ArraySumTest> },
+    { "ArrayInsertTest", createTest<ArrayInsertTest> },
+    { "ListInsertTest", createTest<ListInsertTest> },
+    { "TreeInsertTest", createTest<TreeInsertTest> },
+    { "TreeRemoveTest", createTest<TreeRemoveTest> },
+    { "HashInsertTest", createTest<HashInsertTest> },
+    { "MixedTreeSetTest", createTest<MixedTreeSetTest> },
+    { "MixedTreeMapTest", createTest<MixedTreeMapTest> },
+    { "MixedHashMapTest", createTest<MixedHashMapTest> },
+//    { "BankTest", createTest<BankTest> },
+};
+
+/**
+ * Machine-readable outputs, enabled by command line arguments
+ */
+struct Outputs {
+    Utils::Environment environment;
+    Utils::JsonWriter json;
+    Utils::CsvWriter csv;
+    // directory of binary input files shared between runs and testers
+    string inputDir;
+};
+
+/**
+ * Parts of a test run timed with the TSC
+ */
+enum Phase {
+    PHASE_GENERATE,
+    PHASE_SETUP,
+    PHASE_RUN,
+    PHASE_CHECK,
+    PHASE_TEARDOWN,
+    PHASES_COUNT
+};
+
+static const char *PHASE_NAMES[PHASES_COUNT] = {
+    "generate", "setup", "run", "check", "teardown"
+};
+
+static string toUpper(string str) {
+    transform(str.begin(), str.end(), str.begin(), ::toupper);
+    return str;
+}
+
+static string toString(const Options& options) {
+    string result;
+    for (Options::const_iterator it = options.begin(); it != options.end(); ++it) {
+        result += (result.empty() ? "" : " ") + it->first + "=" + it->second;
+    }
+
+    return result;
+}
+
+static void addEnvironment(Utils::Record& record, const Utils::Environment& env) {
+    record.add("hostname", env.hostname);
+    record.add("kernel", env.kernel);
+    record.add("cpu_model", env.cpuModel);
+    record.add("cpus", static_cast<uint64_t>(env.cpusCount));
+    record.add("governor", env.governor);
+    record.add("compiler", env.compiler);
+    record.add("flags", env.flags);
+    record.add("revision", env.revision);
+    record.add("start_time", env.startTime);
+    record.add("tsc_ghz", env.tscFrequency);
+    record.add("tsc_invariant", env.tscInvariant ? "yes" : "no");
+}
+
+#ifdef CRITICAL_SECTION_STATS
+static double perEntry(uint64_t cycles, uint64_t entries) {
+    return (entries > 0) ? (double) cycles / entries : 0.0;
+}
+#endif
+
+/**
+ * Commits, aborts and serial irrevocable executions of transactions
+ */
+static void printTransactions(const Locks::TMStats& stats, bool withReasons) {
+    const uint64_t aborts = stats.attempts - stats.commits;
+    cout << " commits " << stats.commits << ", aborts " << aborts << " ("
+         << setprecision(1) << 100.0 * aborts / stats.attempts << "%), irrevocable "
+         << stats.irrevocable << setprecision(3);
+
+    if (withReasons && stats.hasReasons) {
+        cout << ", aborts by reason:";
+        for (size_t reason = 0; reason < Locks::TMStats::ABORT_REASONS_COUNT; reason++) {
+            cout << " " << Locks::TMStats::reasonName(reason) << " " << stats.aborts[reason];
+        }
+    }
+}
+
+/**
+ * Ratio of the maximum to the mean, 1 means perfect balance
+ */
+static double imbalance(const vector<double>& values) {
+    const Utils::Statistics stats(values);
+    return (stats.mean() > 0.0) ? stats.max() / stats.mean() : 1.0;
+}
+
+/**
+ * Print performance events summed over measured runs and per operation
+ */
+static void printCounters(const Utils::PerfCounters::Values& counters,
+                          const string& error, uint64_t operations) {
+    if (!counters.isAvailable()) {
+        cout << "\tCounters: unavailable" << (error.empty() ? "" : " (" + error + ")") << endl;
+        return;
+    }
+
+    cout << "\tCounters (total, per op):";
+    for (size_t event = 0; event < Utils::PerfCounters::EVENTS_COUNT; event++) {
+        cout << (event > 0 ? "," : "") << " " << Utils::PerfCounters::eventName(event);
+        if (counters.available[event]) {
+            cout << " " << counters.value[event] << " "
+                 << (double) counters.value[event] / max<uint64_t>(operations, 1);
+        } else {
+            cout << " n/a";
+        }
+    }
+
+    if (counters.available[Utils::PerfCounters::CYCLES] &&
+            counters.available[Utils::PerfCounters::INSTRUCTIONS] &&
+            counters.value[Utils::PerfCounters::CYCLES] > 0) {
+        cout << ", IPC " << (double) counters.value[Utils::PerfCounters::INSTRUCTIONS] /
+                            counters.value[Utils::PerfCounters::CYCLES];
+    }
+
+    if (!error.empty()) {
+        cout << " (n/a: " << error << ")";
+    }
+
+    cout << endl;
+}
+
+/**
+ * Run one config line for one backend,
+ * returns the mean throughput (ops/ms) or 0 on failure
+ */
+static double runTest(ITest *test, const string& testName, const string& backend,
+                    size_t threadsCount, size_t inputSize, size_t repeatCount,
+                    const Options& options, Outputs& outputs)
+{
+    const string lockType = toUpper(backend);
+
+    cout << "Test: " << testName << endl;
+    cout << "Backend: " << lockType << endl;
+    cout << "Threads count: " << threadsCount << endl;
+    cout << "Input size: " << inputSize << endl;
+    cout << "Repeat count: " << repeatCount << endl;
+    cout << "Seed: " << options.find("seed")->second << endl;
+    if (options.count("dist") > 0) {
+        cout << "Distribution: " << options.find("dist")->second << endl;
+    }
+    if (options.count("cache") > 0) {
+        cout << "Cache: " << options.find("cache")->second << endl;
+    }
+
+    if (!test->configure(options)) {
+        cout << endl << "> " << testName << " " << lockType << " fail" << endl;
+        cout << endl << endl;
+        return 0.0;
+    }
+
+    size_t warmupCount = 0;
+    if (options.count("warmup") > 0) {
+        warmupCount = strtoul(options.find("warmup")->second.c_str(), NULL, 10);
+        cout << "Warm-up count: " << warmupCount << endl;
+    }
+
+    vector<double> msValues;
+    vector<double> throughputs;
+    vector<uint64_t> threadOperations(threadsCount, 0);
+    vector<double> threadBusyMs(threadsCount, 0.0);
+    vector<double> threadFinishMs(threadsCount, 0.0);
+    vector<Locks::SectionStats> threadSections(threadsCount);
+    Locks::TMStats transactions;
+    Utils::PerfCounters::Values counters;
+    string countersError;
+    Utils::Histogram latency;
+    // of the last measured run
+    Utils::ContainerStats containerStats;
+    bool hasContainerStats = false;
+    // TSC cycles of test phases summed over measured runs
+    uint64_t phaseCycles[PHASES_COUNT] = { 0 };
+    uint64_t busyCycles = 0;
+
+    bool isOk = true;
+    double throughput = 0.0;
+
+    for (size_t i = 0; i < warmupCount + repeatCount; i++) {
+        const bool isWarmup = (i < warmupCount);
+
+        uint64_t phases[PHASES_COUNT] = { 0 };
+        uint64_t phaseStart = Utils::Timer::cycles();
+        auto endPhase = [&](size_t phase) {
+            const uint64_t now = Utils::Timer::cyclesAfter();
+            phases[phase] = now - phaseStart;
+            phaseStart = now;
+        };
+
+        test->generate(inputSize, threadsCount);
+        endPhase(PHASE_GENERATE);
+
+        test->setup();
+        test->prepareCaches();
+        endPhase(PHASE_SETUP);
+
+        // only accesses of the measured part are counted
+        Utils::Heatmap *heatmap = test->heatmap();
+        if (heatmap != NULL) {
+            heatmap->reset();
+        }
+
+        cout << setw(20) << left << (isWarmup ? "\tWarm-up..." : "\tRun...");
+        phaseStart = Utils::Timer::cycles();
+        const RunResult result = test->run();
+        endPhase(PHASE_RUN);
+
+        // check() may access the container too
+        ostringstream heatmapReport;
+        if (heatmap != NULL) {
+            heatmap->report(heatmapReport);
+        }
+
+        // results of fixed-duration runs are not checked
+        phaseStart = Utils::Timer::cycles();
+        const bool isChecked = !result.complete || test->check();
+        endPhase(PHASE_CHECK);
+
+        if (isChecked) {
+            const double ms = result.elapsed.count() * 1e-6;
+            const size_t opsPerSec = static_cast<size_t>(ceil((double) result.operations / ms));
+
+            cout << "OK " << fixed << setprecision(3) << ms << " ms, " << opsPerSec << " ops/s";
+            if (result.transactions.attempts > 0) {
+                cout << ",";
+                printTransactions(result.transactions, false);
+            }
+            cout << endl << heatmapReport.str();
+
+            if (!isWarmup) {
+                msValues.push_back(ms);
+                throughputs.push_back(result.operations / ms);
+                for (size_t t = 0; t < result.threadOperations.size() && t < threadsCount; t++) {
+                    threadOperations[t] += result.threadOperations[t];
+                    threadBusyMs[t] += result.threadBusy[t].count() * 1e-6 / repeatCount;
+                    threadFinishMs[t] += result.threadFinish[t].count() * 1e-6 / repeatCount;
+                    threadSections[t].merge(result.threadSections[t]);
+                }
+
+                counters.merge(result.counters);
+                transactions.merge(result.transactions);
+                countersError = result.countersError;
+
+                if (test->latency() != NULL) {
+                    latency.merge(*test->latency());
+                }
+
+                hasContainerStats = test->containerStats(&containerStats);
+                busyCycles += result.busyCycles;
+            }
+        } else {
+            isOk = false;
+            cout << "FAIL " << endl;
+        }
+
+        phaseStart = Utils::Timer::cycles();
+        test->teardown();
+        endPhase(PHASE_TEARDOWN);
+
+        if (!isWarmup) {
+            for (size_t phase = 0; phase < PHASES_COUNT; phase++) {
+                phaseCycles[phase] += phases[phase];
+            }
+        }
+
+        if (isWarmup && i + 1 == warmupCount) {
+            // warm-up results are discarded
+            test->clearResults();
+        }
+
+        cout << flush;
+    }
+
+    if (isOk && repeatCount > 0) {
+        const Utils::Statistics msStats(msValues);
+        const Utils::Statistics opsStats(throughputs);
+
+        const double msThreadedAv = msStats.mean();
+        const size_t opsPerSecAv = static_cast<size_t>(ceil(opsStats.mean()));
+        throughput = opsStats.mean();
+
+        double ciLow = 0.0, ciHigh = 0.0;
+        opsStats.bootstrap(0.95, strtoull(options.find("seed")->second.c_str(), NULL, 0),
+                           &ciLow, &ciHigh);
+
+        cout << endl;
+        test->report(cout);
+
+        cout << endl << "\tThroughput: mean " << opsStats.mean()
+             << ", median " << opsStats.median()
+             << ", min " << opsStats.min()
+             << ", max " << opsStats.max()
+             << ", stddev " << opsStats.stddev()
+             << ", 95% CI [" << ciLow << ", " << ciHigh << "]" << endl;
+
+        const vector<size_t> outliers = opsStats.outliers();
+        if (!outliers.empty()) {
+            cout << "\tOutliers:";
+            for (size_t run: outliers) {
+                cout << " run " << run + 1 << " (" << throughputs[run] << ")";
+            }
+            cout << endl;
+        }
+
+        cout << "\tLatency: p50 " << latency.percentile(50.0) << " ns, p99 "
+             << latency.percentile(99.0) << " ns, p99.9 "
+             << latency.percentile(99.9) << " ns, max "
+             << latency.max() << " ns" << endl;
+
+        cout << "\tThreads (mean per run):" << endl;
+        for (size_t t = 0; t < threadsCount; t++) {
+            cout << "\t\tthread " << t << ": " << threadOperations[t] / repeatCount
+                 << " ops, busy " << threadBusyMs[t] << " ms, finish "
+                 << threadFinishMs[t] << " ms";
+#ifdef CRITICAL_SECTION_STATS
+            const Locks::SectionStats& stats = threadSections[t];
+            cout << ", wait " << perEntry(stats.waitCycles, stats.entries)
+                 << ", hold " << perEntry(stats.holdCycles, stats.entries) << " cycles/entry";
+#endif
+            cout << endl;
+        }
+
+        Locks::SectionStats sections;
+        for (const Locks::SectionStats& stats: threadSections) {
+            sections.merge(stats);
+        }
+
+#ifdef CRITICAL_SECTION_STATS
+        cout << "\tCritical sections: " << sections.entries << " entries, "
+             << sections.attempts << " attempts (" << sections.attempts - sections.entries
+             << " aborted), wait " << perEntry(sections.waitCycles, sections.entries)
+             << ", hold " << perEntry(sections.holdCycles, sections.entries)
+             << " cycles/entry, aborted attempt "
+             << perEntry(sections.abortedCycles, sections.attempts - sections.entries)
+             << " cycles" << endl;
+#endif
+
+        const double opsImbalance = imbalance(vector<double>(threadOperations.begin(),
+                                                             threadOperations.end()));
+        const double busyImbalance = imbalance(threadBusyMs);
+        const double finishImbalance = imbalance(threadFinishMs);
+        cout << "\tImbalance (max/mean): ops " << opsImbalance << ", busy "
+             << busyImbalance << ", finish " << finishImbalance << endl;
+
+        if (transactions.attempts > 0) {
+            cout << "\tTransactions:";
+            printTransactions(transactions, true);
+            cout << endl;
+        }
+
+        if (hasContainerStats) {
+            containerStats.report(cout);
+        }
+
+        const Utils::Timer& timer = Utils::Timer::instance();
+        cout << "\tPhases (mean per run):";
+        for (size_t phase = 0; phase < PHASES_COUNT; phase++) {
+            const double cycles = (double) phaseCycles[phase] / repeatCount;
+            cout << " " << PHASE_NAMES[phase] << " " << timer.toNs(cycles) * 1e-6
+                 << " ms (" << cycles * 1e-6 << " Mcycles)";
+        }
+        cout << endl;
+
+        uint64_t totalOperations = 0;
+        for (uint64_t operations: threadOperations) {
+            totalOperations += operations;
+        }
+
+        // busy time of all threads includes the work outside of critical sections
+        const double cyclesPerOp = (totalOperations > 0) ?
+                    (double) busyCycles / totalOperations : 0.0;
+        cout << "\tPer operation (busy time of threads): " << cyclesPerOp << " cycles, "
+             << timer.toNs(cyclesPerOp) << " ns" << endl;
+
+        if (options.count("perf") > 0 && options.find("perf")->second != "0") {
+            printCounters(counters, countersError, totalOperations);
+        }
+
+        cout << endl << "> " << testName << " " << lockType << " OK "
+             << inputSize << " " << threadsCount << " " <<
+                repeatCount << " " <<
+                msThreadedAv << " " << opsPerSecAv << " " <<
+                latency.percentile(50.0) << " " << latency.percentile(99.0) << " " <<
+                latency.percentile(99.9) << " " <<
+                opsStats.median() << " " << opsStats.stddev() << " " <<
+                ciLow << " " << ciHigh << " " << outliers.size() << endl;
+
+        Utils::Record record;
+        record.add("test", testName);
+        record.add("backend", backend);
+        record.add("threads", static_cast<uint64_t>(threadsCount));
+        record.add("input_size", static_cast<uint64_t>(inputSize));
+        record.add("repeat", static_cast<uint64_t>(repeatCount));
+        record.add("warmup", static_cast<uint64_t>(warmupCount));
+        record.add("seed", options.find("seed")->second);
+        record.add("dist", options.count("dist") > 0 ? options.find("dist")->second : "uniform");
+        record.add("cache", options.count("cache") > 0 ? options.find("cache")->second : "default");
+        record.add("options", toString(options));
+        record.add("ms", msValues);
+        record.add("ms_mean", msStats.mean());
+        record.add("ms_median", msStats.median());
+        record.add("ms_stddev", msStats.stddev());
+        record.add("ops_per_ms", throughputs);
+        record.add("ops_per_ms_mean", opsStats.mean());
+        record.add("ops_per_ms_median", opsStats.median());
+        record.add("ops_per_ms_min", opsStats.min());
+        record.add("ops_per_ms_max", opsStats.max());
+        record.add("ops_per_ms_stddev", opsStats.stddev());
+        record.add("ops_per_ms_ci_low", ciLow);
+        record.add("ops_per_ms_ci_high", ciHigh);
+        record.add("outliers", outliers);
+        record.add("latency_p50_ns", latency.percentile(50.0));
+        record.add("latency_p99_ns", latency.percentile(99.0));
+        record.add("latency_p999_ns", latency.percentile(99.9));
+        record.add("latency_max_ns", latency.max());
+        record.add("thread_operations_total", threadOperations);
+        record.add("thread_busy_ms", threadBusyMs);
+        record.add("thread_finish_ms", threadFinishMs);
+        record.add("imbalance_ops", opsImbalance);
+        record.add("imbalance_busy", busyImbalance);
+        record.add("imbalance_finish", finishImbalance);
+        record.add("tm_attempts", transactions.attempts);
+        record.add("tm_commits", transactions.commits);
+        record.add("tm_aborts", transactions.attempts - transactions.commits);
+        record.add("tm_irrevocable", transactions.irrevocable);
+        for (size_t reason = 0; reason < Locks::TMStats::ABORT_REASONS_COUNT; reason++) {
+            // -1 if the runtime doesn't report reasons
+            record.add(string("tm_aborts_") + Locks::TMStats::reasonName(reason),
+                       transactions.hasReasons ? (double) transactions.aborts[reason] : -1.0);
+        }
+        // zeros unless compiled with CRITICAL_SECTION_STATS
+        record.add("cs_entries", sections.entries);
+        record.add("cs_attempts", sections.attempts);
+        record.add("cs_wait_cycles", sections.waitCycles);
+        record.add("cs_hold_cycles", sections.holdCycles);
+        record.add("cs_aborted_cycles", sections.abortedCycles);
+        for (size_t event = 0; event < Utils::PerfCounters::EVENTS_COUNT; event++) {
+            // -1 if not requested or unavailable
+            record.add(Utils::PerfCounters::eventName(event), counters.available[event] ?
+                       static_cast<double>(counters.value[event]) : -1.0);
+        }
+        for (size_t phase = 0; phase < PHASES_COUNT; phase++) {
+            const double cycles = (double) phaseCycles[phase] / repeatCount;
+            record.add(string("phase_") + PHASE_NAMES[phase] + "_cycles", cycles);
+            record.add(string("phase_") + PHASE_NAMES[phase] + "_ms", timer.toNs(cycles) * 1e-6);
+        }
+        record.add("cycles_per_op", cyclesPerOp);
+        record.add("ns_per_op", timer.toNs(cyclesPerOp));
+        // empty or zeros if the test doesn't have a shared container
+        record.add("container", containerStats.kind);
+        record.add("container_size", static_cast<uint64_t>(containerStats.size));
+        record.add("container_nodes", static_cast<uint64_t>(containerStats.nodes));
+        record.add("container_bytes", static_cast<uint64_t>(containerStats.bytes));
+        record.add("container_capacity", static_cast<uint64_t>(containerStats.capacity));
+        record.add("container_load_factor", containerStats.loadFactor);
+        record.add("container_chains", containerStats.chainLengths);
+        record.add("container_max_chain", static_cast<uint64_t>(containerStats.maxChain));
+        record.add("container_max_depth", static_cast<uint64_t>(containerStats.maxDepth));
+        record.add("container_avg_depth", containerStats.avgDepth);
+        record.add("container_black_height", static_cast<uint64_t>(containerStats.blackHeight));
+        addEnvironment(record, outputs.environment);
+
+        outputs.json.write(record);
+        outputs.csv.write(record);
+    } else {
+        cout << endl << "> " << testName << " " << lockType << " fail" << endl;
+    }
+
+    cout << endl << endl;
+    return throughput;
+}
+
+/**
+ * Expands "FROM..TO[:xFACTOR|:+STEP]" (default step is +1) into a list of
+ * values. Any other spec, e.g. a path with "..", is a single value.
+ * Returns false on invalid sweep.
+ */
+static bool expandSweep(const string& spec, vector<string> *values) {
+    values->clear();
+
+    const size_t dots = spec.find("..");
+    if (dots == string::npos) {
+        values->push_back(spec);
+        return true;
+    }
+
+    const size_t colon = spec.find(':', dots);
+    const string fromStr = spec.substr(0, dots);
+    const string toStr = spec.substr(dots + 2, colon == string::npos ?
+                                     string::npos : colon - dots - 2);
+    string stepStr = (colon == string::npos) ? "+1" : spec.substr(colon + 1);
+
+    char *fromEnd;
+    char *toEnd;
+    const double from = strtod(fromStr.c_str(), &fromEnd);
+    const double to = strtod(toStr.c_str(), &toEnd);
+    if (fromStr.empty() || *fromEnd != '\0' || toStr.empty() || *toEnd != '\0') {
+        // not numbers, so not a sweep
+        values->push_back(spec);
+        return true;
+    }
+
+    if (to < from) {
+        return false;
+    }
+
+    char *end;
+
+    if (stepStr.size() < 2 || (stepStr[0] != 'x' && stepStr[0] != '+')) {
+        return false;
+    }
+
+    const bool isMultiply = (stepStr[0] == 'x');
+    const double step = strtod(stepStr.c_str() + 1, &end);
+    if (*end != '\0' || (isMultiply && step <= 1.0) || (!isMultiply && step <= 0.0)) {
+        return false;
+    }
+
+    // tolerance for accumulated rounding errors
+    const double last = to * (1.0 + 1e-9);
+    for (double value = from; value <= last;
+         value = isMultiply ? value * step : value + step) {
+        ostringstream str;
+        str << setprecision(12) << value;
+        values->push_back(str.str());
+    }
+
+    return true;
+}
+
+/**
+ * Parses a non-negative integer parameter, exponent form ("1e6") is allowed
+ * since sweeps may produce it. Returns false on garbage or fractions.
+ */
+static bool parseCount(const string& str, size_t *value) {
+    char *end;
+    const double number = strtod(str.c_str(), &end);
+    if (str.empty() || *end != '\0' || !(number >= 0.0) ||
+            number > (double) numeric_limits<uint32_t>::max() || number != floor(number)) {
+        return false;
+    }
+
+    *value = static_cast<size_t>(number);
+    return true;
+}
+
+/**
+ * Moves to the next combination of swept values, the first sweep changes
+ * fastest. Returns false after the last combination.
+ */
+static bool nextSweepPoint(const vector< pair<string, vector<string> > >& sweeps,
+                           vector<size_t> *position) {
+    for (size_t i = 0; i < sweeps.size(); i++) {
+        if (++(*position)[i] < sweeps[i].second.size()) {
+            return true;
+        }
+
+        (*position)[i] = 0;
+    }
+
+    return false;
+}
+
+struct SweepResult {
+    string backend;
+    // values of swept parameters except threads
+    string point;
+    size_t threadsCount;
+    double throughput;
 };
 
-typedef std::chrono::high_resolution_clock Clock;
+/**
+ * Speedup and parallel efficiency relative to the smallest threads count
+ * (normally 1) of the same backend and other parameters
+ */
+static void reportScaling(const string& testName, const vector<SweepResult>& results) {
+    set< pair<string, string> > series;
+    for (const SweepResult& result: results) {
+        series.insert(make_pair(result.backend, result.point));
+    }
+
+    for (const pair<string, string>& key: series) {
+        vector<const SweepResult *> points;
+        for (const SweepResult& result: results) {
+            if (result.backend == key.first && result.point == key.second &&
+                result.throughput > 0.0) {
+                points.push_back(&result);
+            }
+        }
+
+        if (points.size() < 2) {
+            continue;
+        }
 
+        const SweepResult *base = points[0];
+        cout << "Scaling: " << testName << " " << toUpper(key.first) << key.second
+             << " (relative to " << base->threadsCount << " threads)" << endl;
 
+        ostringstream summary;
+        double prevSpeedup = 0.0;
+        for (const SweepResult *point: points) {
+            const double speedup = point->throughput / base->throughput;
+            const double efficiency = speedup * base->threadsCount / point->threadsCount;
+
+            cout << "\tThreads " << setw(4) << right << point->threadsCount << ": "
+                 << fixed << setprecision(3) << point->throughput << " ops/ms, speedup "
+                 << speedup << ", efficiency " << setprecision(1) << efficiency * 100.0 << "%"
+                 << (speedup < prevSpeedup ? " (collapse)" : "") << endl;
+            prevSpeedup = speedup;
+
+            summary << ">> " << testName << " " << toUpper(key.first) << key.second
+                    << " " << point->threadsCount << " " << fixed << setprecision(3)
+                    << speedup << " " << efficiency << endl;
+        }
+
+        cout << endl << summary.str() << endl;
+    }
+
+    cout << endl;
+}
 
 int main(int argc, char *argv[])
 {
-    std::cerr << "Tester compiled with LOCKTYPE_" << LOCKTYPE << endl;
+    cerr << "Available backends:";
+    for (const string& backend: BACKENDS) {
+        cerr << " " << backend;
+    }
+    cerr << endl;
+    cerr << "Default backend: " << DEFAULT_BACKEND << endl;
 
-    if (argc > 1) {
-        cerr << "Usage: " << argv[0] << " < tests.cfg" << endl << flush;
-        return 1;
+    Outputs outputs;
+    outputs.environment = Utils::Environment::collect();
+
+    cerr << "TSC: " << outputs.environment.tscFrequency << " GHz" << endl;
+    if (!outputs.environment.tscInvariant) {
+        cerr << "Warning: TSC is not invariant, cycles are converted "
+                "to time with the calibrated frequency" << endl;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        bool isOk = false;
+        if (arg.compare(0, 7, "--json=") == 0) {
+            isOk = outputs.json.open(arg.substr(7));
+        } else if (arg.compare(0, 6, "--csv=") == 0) {
+            isOk = outputs.csv.open(arg.substr(6));
+        } else if (arg.compare(0, 12, "--input-dir=") == 0) {
+            outputs.inputDir = arg.substr(12);
+            isOk = !outputs.inputDir.empty();
+        } else {
+            cerr << "Usage: " << argv[0]
+                 << " [--json=FILE] [--csv=FILE] [--input-dir=DIR] < tests.cfg"
+                 << endl << flush;
+            return 1;
+        }
+
+        if (!isOk) {
+            cerr << "Can't open output file: " << arg << endl;
+            return 1;
+        }
     }
 
     cout << "Wating for configuration data from stdin..." << endl;
@@ -77,26 +788,40 @@ int main(int argc, char *argv[])
     size_t testsCount = 0;
     while(true) {
         string testName;
-        size_t threadsCount;
-        size_t inputSize;
-        size_t repeatCount;
+        Options options;
 
         const int sym = cin.get();
         if (sym == -1) {
             // end of file
             break;
-        } else if (!std::isalpha(sym)) {
+        }
+
+        cin.unget();
+        string line;
+        getline(cin, line);
+
+        if (!std::isalpha(sym)) {
             // skip comment and white space
-            cin.unget();
-            string line;
-            getline(cin, line);
             continue;
-        } else {
-            cin.unget();
-            cin >> testName >> threadsCount >> inputSize >> repeatCount;
-            if (!cin.good()) {
+        }
+
+        // positional parameters may be sweeps too
+        istringstream lineStream(line);
+        lineStream >> testName >> options["threads"] >> options["size"] >> options["repeat"];
+        if (lineStream.fail()) {
+            continue;
+        }
+
+        // optional key=value parameters
+        string option;
+        while (lineStream >> option) {
+            const size_t eq = option.find('=');
+            if (eq == string::npos) {
+                cerr << "Invalid option: " << option << endl;
                 continue;
             }
+
+            options[option.substr(0, eq)] = option.substr(eq + 1);
         }
 
         TestsMap::const_iterator it = TESTS.find(testName);
@@ -105,66 +830,125 @@ int main(int argc, char *argv[])
             continue;
         }
 
-        cout << "Test: " << testName << endl;
-        cout << "Threads count: " << threadsCount << endl;
-        cout << "Input size: " << inputSize << endl;
-        cout << "Repeat count: " << repeatCount << endl;
+        if (options.count("seed") == 0) {
+            // the same seed for all backends, so they run on the same input
+            random_device rnd;
+            ostringstream seed;
+            seed << ((static_cast<uint64_t>(rnd()) << 32) | rnd());
+            options["seed"] = seed.str();
+        }
+
+        // swept parameters, "threads" first so it changes fastest
+        vector< pair<string, vector<string> > > sweeps;
+        bool isValid = true;
+        for (Options::const_iterator opt = options.begin(); opt != options.end(); ++opt) {
+            vector<string> values;
+            if (!expandSweep(opt->second, &values)) {
+                cerr << "Invalid sweep: " << opt->first << "=" << opt->second << endl;
+                isValid = false;
+            } else if (values.size() > 1) {
+                sweeps.insert(opt->first == "threads" ? sweeps.begin() : sweeps.end(),
+                              make_pair(opt->first, values));
+            }
+        }
 
-#ifdef LOCKTYPE_NONE
-        if (threadsCount > 1) {
-            cerr << "Skipping multithread test due to LOCKTYPE_NONE defined" << endl;
+        if (!isValid) {
             continue;
         }
-#endif
 
-        ITest *test = it->second();
-        double msThreadedAv = 0.0;
+        vector<SweepResult> results;
+        vector<size_t> position(sweeps.size(), 0);
+        do {
+            Options pointOptions = options;
+            string pointName;
+            for (size_t i = 0; i < sweeps.size(); i++) {
+                pointOptions[sweeps[i].first] = sweeps[i].second[position[i]];
+                if (sweeps[i].first != "threads") {
+                    pointName += " " + sweeps[i].first + "=" + sweeps[i].second[position[i]];
+                }
+            }
 
-        bool isOk = true;
+            size_t threadsCount;
+            size_t inputSize;
+            size_t repeatCount;
+            if (!parseCount(pointOptions["threads"], &threadsCount) || threadsCount < 1 ||
+                    !parseCount(pointOptions["size"], &inputSize) || inputSize < 1 ||
+                    !parseCount(pointOptions["repeat"], &repeatCount)) {
+                cerr << "Invalid parameters: " << pointOptions["threads"] << " "
+                     << pointOptions["size"] << " " << pointOptions["repeat"] << endl;
+                continue;
+            }
 
-        for (size_t i = 0; i < repeatCount; i++) {
-            test->generate(inputSize, threadsCount);
+            pointOptions.erase("threads");
+            pointOptions.erase("size");
+            pointOptions.erase("repeat");
 
-            test->setup();
+            if (!outputs.inputDir.empty() && pointOptions.count("input") == 0) {
+                // the input depends only on size, seed and distribution
+                ostringstream path;
+                path << outputs.inputDir << "/keys-" << inputSize << "-" << pointOptions["seed"]
+                     << "-" << (pointOptions.count("dist") > 0 ? pointOptions["dist"] : "uniform")
+                     << ".bin";
+                pointOptions["input"] = path.str();
+            }
 
-            cout << setw(20) << left << "\tRun...";
-            Clock::time_point t0 = Clock::now();
-            test->run();
-            Clock::time_point t1 = Clock::now();
+            vector<string> backends;
+            if (pointOptions.count("backend") == 0) {
+                pointOptions["backend"] = DEFAULT_BACKEND;
+            }
 
-            if (test->check()) {
-                const double ms = std::chrono::nanoseconds(t1 - t0).count() * 1e-6;
-                const size_t opsPerSec = static_cast<size_t>(ceil((double) inputSize / ms));
+            const bool allBackends = (pointOptions["backend"] == "all");
+            if (allBackends) {
+                // run all backends suitable for this threads count
+                for (const string& backend: BACKENDS) {
+                    if (threadsCount > 1 && backend == "none") {
+                        continue;
+                    }
 
-                msThreadedAv += ms;
-                cout << "OK " << fixed << setprecision(3) << ms << " ms, " << opsPerSec << " ops/s" << endl;
+                    backends.push_back(backend);
+                }
             } else {
-                isOk = false;
-                cout << "FAIL " << endl;
+                istringstream backendsStream(pointOptions["backend"]);
+                string backend;
+                while (getline(backendsStream, backend, ',')) {
+                    backends.push_back(backend);
+                }
             }
 
-            test->teardown();
+            for (const string& backend: backends) {
+                ITest *test = it->second(backend);
+                if (test == NULL) {
+                    if (find(BACKENDS.begin(), BACKENDS.end(), backend) == BACKENDS.end()) {
+                        cerr << "Backend not found: " << backend << endl;
+                    } else if (!allBackends) {
+                        cerr << "Backend " << backend << " doesn't support " << it->first << endl;
+                    }
 
-            cout << flush;
-        }
+                    continue;
+                }
 
-        if (isOk) {
-            msThreadedAv /= repeatCount;
+                if (threadsCount > 1 && backend == "none") {
+                    cerr << "Skipping multithread test for backend none" << endl;
+                    delete test;
+                    continue;
+                }
 
-            size_t opsPerSecAv = static_cast<size_t>(ceil((double) inputSize / msThreadedAv));
+                SweepResult result;
+                result.backend = backend;
+                result.point = pointName;
+                result.threadsCount = threadsCount;
+                result.throughput = runTest(test, testName, backend, threadsCount,
+                                            inputSize, repeatCount, pointOptions, outputs);
+                results.push_back(result);
 
-            cout << endl << "> " << testName << " " << LOCKTYPE << " OK "
-                 << inputSize << " " << threadsCount << " " <<
-                    repeatCount << " " <<
-                    msThreadedAv << " " << opsPerSecAv << endl;
-        } else {
-            cout << endl << "> " << testName << " fail" << endl;
-        }
-
-        delete test;
+                delete test;
+                testsCount++;
+            }
+        } while (nextSweepPoint(sweeps, &position));
 
-        cout << endl << endl;
-        testsCount++;
+        if (!sweeps.empty() && sweeps[0].first == "threads") {
+            reportScaling(testName, results);
+        }
     }
 
     if (testsCount > 0) {